@@ -3,7 +3,18 @@
 #include <string.h>
 #include <stdio.h>
 #include "devices/ide.h"
+#include "devices/timer.h"
 #include "threads/malloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+/* Most sectors that merging may put in one transfer. */
+#define MERGE_MAX 128
+
+/* Ticks within which the deadline scheduler serves a read or a
+   write, once it is queued. */
+#define READ_DEADLINE (TIMER_FREQ / 2)
+#define WRITE_DEADLINE (5 * TIMER_FREQ)
 
 /* A block device. */
 struct block
@@ -17,10 +28,41 @@ struct block
     const struct block_operations *ops;  /* Driver operations. */
     void *aux;                          /* Extra data owned by driver. */
 
+    struct block *lower;                /* Device requests really go to. */
+    block_sector_t lower_start;         /* Our sector 0 on LOWER. */
+
+    /* Request queue, protected by QUEUE_LOCK. */
+    struct lock queue_lock;
+    struct condition queue_ready;       /* Signaled on new requests. */
+    struct list sorted;                 /* Queued requests by sector. */
+    struct list fifo;                   /* Queued requests by arrival. */
+    block_sector_t head;                /* Sector after the last served. */
+    bool busy;                          /* Transfer in progress? */
+    bool worker_started;                /* I/O thread created? */
+
     unsigned long long read_cnt;        /* Number of sectors read. */
     unsigned long long write_cnt;       /* Number of sectors written. */
+    unsigned long long merge_cnt;       /* Number of requests merged. */
   };
 
+/* An I/O scheduler, which picks the next request to serve from
+   the nonempty queue of BLOCK.  Called with the queue locked. */
+struct block_scheduler
+  {
+    const char *name;
+    struct block_request *(*next) (struct block *);
+  };
+
+static const struct block_scheduler fifo_scheduler, clook_scheduler,
+  deadline_scheduler;
+
+/* Schedulers that can be chosen with "-iosched". */
+static const struct block_scheduler *const schedulers[] =
+  {&fifo_scheduler, &clook_scheduler, &deadline_scheduler};
+
+/* Scheduler in use. */
+static const struct block_scheduler *scheduler = &deadline_scheduler;
+
 /* List of all block devices. */
 static struct list all_blocks = LIST_INITIALIZER (all_blocks);
 
@@ -120,9 +162,7 @@ check_sector (struct block *block, block_sector_t sector)
 void
 block_read (struct block *block, block_sector_t sector, void *buffer)
 {
-  check_sector (block, sector);
-  block->ops->read (block->aux, sector, buffer);
-  block->read_cnt++;
+  block_read_multiple (block, sector, 1, &buffer);
 }
 
 /* Write sector SECTOR to BLOCK from BUFFER, which must contain
@@ -132,11 +172,371 @@ block_read (struct block *block, block_sector_t sector, void *buffer)
    per-block device locking is unneeded. */
 void
 block_write (struct block *block, block_sector_t sector, const void *buffer)
+{
+  block_write_multiple (block, sector, 1, &buffer);
+}
+
+/* Verifies that the CNT sectors starting at SECTOR all lie
+   within BLOCK.  Panics if not. */
+static void
+check_sectors (struct block *block, block_sector_t sector, size_t cnt)
 {
   check_sector (block, sector);
-  ASSERT (block->type != BLOCK_FOREIGN);
-  block->ops->write (block->aux, sector, buffer);
-  block->write_cnt++;
+  if (cnt > block->size - sector)
+    PANIC ("Access past end of device %s (sector=%"PRDSNu", count=%zu, "
+           "size=%"PRDSNu")\n", block_name (block), sector, cnt, block->size);
+}
+
+/* Reads the CNT sectors starting at SECTOR from BLOCK, the Nth
+   of them into BUFFERS[N], each of which must have room for
+   BLOCK_SECTOR_SIZE bytes.  Drivers that support it move all of
+   them in as few device commands as possible.
+   Internally synchronizes accesses to block devices, so external
+   per-block device locking is unneeded. */
+void
+block_read_multiple (struct block *block, block_sector_t sector, size_t cnt,
+                     void *const buffers[])
+{
+  struct block_request r;
+
+  if (cnt == 0)
+    return;
+  r.sector = sector;
+  r.cnt = cnt;
+  r.write = false;
+  r.buffers = buffers;
+  block_submit_wait (block, &r);
+}
+
+/* Writes the CNT sectors starting at SECTOR to BLOCK, the Nth of
+   them from BUFFERS[N], each of which must contain
+   BLOCK_SECTOR_SIZE bytes.  Returns after the block device has
+   acknowledged receiving all the data.
+   Internally synchronizes accesses to block devices, so external
+   per-block device locking is unneeded. */
+void
+block_write_multiple (struct block *block, block_sector_t sector, size_t cnt,
+                      const void *const buffers[])
+{
+  struct block_request r;
+
+  if (cnt == 0)
+    return;
+  r.sector = sector;
+  r.cnt = cnt;
+  r.write = true;
+  r.buffers = (void *const *) buffers;
+  block_submit_wait (block, &r);
+}
+
+static void block_worker (void *block_);
+static bool try_merge (struct block *, struct block_request *);
+static bool sector_less (const struct list_elem *, const struct list_elem *,
+                         void *aux);
+static void transfer (struct block *, block_sector_t, size_t cnt,
+                      void *const buffers[], bool write);
+
+/* Checks request R for BLOCK and, if BLOCK is a partition, turns
+   R into a request for the disk it lies on, so that requests for
+   all of a disk's partitions are scheduled together.  Returns the
+   device R now goes to. */
+static struct block *
+route_request (struct block *block, struct block_request *r)
+{
+  ASSERT (r->cnt > 0);
+  check_sectors (block, r->sector, r->cnt);
+  ASSERT (!r->write || block->type != BLOCK_FOREIGN);
+
+  while (block->lower != NULL)
+    {
+      if (r->write)
+        block->write_cnt += r->cnt;
+      else
+        block->read_cnt += r->cnt;
+      r->sector += block->lower_start;
+      block = block->lower;
+    }
+  return block;
+}
+
+/* Adds R, already routed by route_request(), to BLOCK's queue.
+   Called with BLOCK's queue lock held. */
+static void
+queue_request (struct block *block, struct block_request *r)
+{
+  r->deadline = timer_ticks () + (r->write ? WRITE_DEADLINE : READ_DEADLINE);
+  if (!try_merge (block, r))
+    {
+      list_init (&r->merged);
+      list_push_back (&r->merged, &r->merge_elem);
+      r->start = r->sector;
+      r->total = r->cnt;
+      list_insert_ordered (&block->sorted, &r->sorted_elem, sector_less, NULL);
+      list_push_back (&block->fifo, &r->fifo_elem);
+    }
+  if (!block->worker_started)
+    {
+      block->worker_started = true;
+      thread_create (block->name, PRI_DEFAULT, block_worker, block);
+    }
+  cond_signal (&block->queue_ready, &block->queue_lock);
+}
+
+/* Queues request R for BLOCK and returns at once.  R->done(R) is
+   called from BLOCK's I/O thread once the transfer is complete,
+   and must not itself wait for I/O on the same device. */
+void
+block_submit (struct block *block, struct block_request *r)
+{
+  block = route_request (block, r);
+  lock_acquire (&block->queue_lock);
+  if (r->write)
+    block->write_cnt += r->cnt;
+  else
+    block->read_cnt += r->cnt;
+  queue_request (block, r);
+  lock_release (&block->queue_lock);
+}
+
+/* Completion function for block_submit_wait(). */
+static void
+wake_submitter (struct block_request *r)
+{
+  sema_up (r->aux);
+}
+
+/* Carries out request R for BLOCK and waits until it is complete.
+   If the device is idle and nothing is queued, the transfer is
+   done right here rather than handed to the I/O thread, which
+   would cost two context switches.  Otherwise R is queued, with
+   its DONE and AUX members set to wake us. */
+void
+block_submit_wait (struct block *block, struct block_request *r)
+{
+  struct semaphore done;
+
+  block = route_request (block, r);
+  lock_acquire (&block->queue_lock);
+  if (r->write)
+    block->write_cnt += r->cnt;
+  else
+    block->read_cnt += r->cnt;
+  if (!block->busy && list_empty (&block->fifo))
+    {
+      block->busy = true;
+      block->head = r->sector + r->cnt;
+      lock_release (&block->queue_lock);
+
+      transfer (block, r->sector, r->cnt, r->buffers, r->write);
+
+      lock_acquire (&block->queue_lock);
+      block->busy = false;
+      cond_signal (&block->queue_ready, &block->queue_lock);
+      lock_release (&block->queue_lock);
+      return;
+    }
+  sema_init (&done, 0);
+  r->done = wake_submitter;
+  r->aux = &done;
+  queue_request (block, r);
+  lock_release (&block->queue_lock);
+  sema_down (&done);
+}
+
+/* Tries to merge R, which is not queued yet, into a queued
+   request of BLOCK in the same direction whose sectors come right
+   before or after R's.  Returns true if successful.  A merge in
+   front moves the queued request's first sector down, so it is
+   put back in its place in BLOCK's sorted list. */
+static bool
+try_merge (struct block *block, struct block_request *r)
+{
+  struct list_elem *e;
+
+  for (e = list_begin (&block->sorted); e != list_end (&block->sorted);
+       e = list_next (e))
+    {
+      struct block_request *q = list_entry (e, struct block_request,
+                                            sorted_elem);
+      if (q->write != r->write || q->total + r->cnt > MERGE_MAX)
+        continue;
+      if (q->start + q->total == r->sector)
+        list_push_back (&q->merged, &r->merge_elem);
+      else if (r->sector + r->cnt == q->start)
+        {
+          list_push_front (&q->merged, &r->merge_elem);
+          q->start = r->sector;
+          list_remove (&q->sorted_elem);
+          list_insert_ordered (&block->sorted, &q->sorted_elem,
+                               sector_less, NULL);
+        }
+      else
+        continue;
+      q->total += r->cnt;
+      if (r->deadline < q->deadline)
+        q->deadline = r->deadline;
+      block->merge_cnt++;
+      return true;
+    }
+  return false;
+}
+
+/* Orders queued requests by first sector. */
+static bool
+sector_less (const struct list_elem *a, const struct list_elem *b,
+             void *aux UNUSED)
+{
+  return (list_entry (a, struct block_request, sorted_elem)->start
+          < list_entry (b, struct block_request, sorted_elem)->start);
+}
+
+/* Moves the CNT sectors starting at SECTOR between BLOCK and
+   BUFFERS using BLOCK's driver. */
+static void
+transfer (struct block *block, block_sector_t sector, size_t cnt,
+          void *const buffers[], bool write)
+{
+  size_t i;
+
+  if (write && block->ops->write_multiple != NULL)
+    block->ops->write_multiple (block->aux, sector, cnt,
+                                (const void *const *) buffers);
+  else if (!write && block->ops->read_multiple != NULL)
+    block->ops->read_multiple (block->aux, sector, cnt, buffers);
+  else
+    for (i = 0; i < cnt; i++)
+      if (write)
+        block->ops->write (block->aux, sector + i, buffers[i]);
+      else
+        block->ops->read (block->aux, sector + i, buffers[i]);
+}
+
+/* I/O thread for BLOCK: serves queued requests one at a time in
+   the order the scheduler picks, and completes them. */
+static void
+block_worker (void *block_)
+{
+  struct block *block = block_;
+  void *buffers[MERGE_MAX];
+
+  lock_acquire (&block->queue_lock);
+  for (;;)
+    {
+      struct block_request *r;
+      void *const *vec;
+      struct list_elem *e;
+
+      /* Wait for a request, and for any transfer that
+         block_submit_wait() is doing itself to finish. */
+      while (list_empty (&block->fifo) || block->busy)
+        cond_wait (&block->queue_ready, &block->queue_lock);
+      r = scheduler->next (block);
+      list_remove (&r->sorted_elem);
+      list_remove (&r->fifo_elem);
+      block->head = r->start + r->total;
+      block->busy = true;
+      lock_release (&block->queue_lock);
+
+      /* Gather the buffers of merged requests into one vector. */
+      if (list_size (&r->merged) == 1)
+        vec = r->buffers;
+      else
+        {
+          size_t n = 0, i;
+          for (e = list_begin (&r->merged); e != list_end (&r->merged);
+               e = list_next (e))
+            {
+              struct block_request *m = list_entry (e, struct block_request,
+                                                    merge_elem);
+              for (i = 0; i < m->cnt; i++)
+                buffers[n++] = m->buffers[i];
+            }
+          vec = buffers;
+        }
+      transfer (block, r->start, r->total, vec, r->write);
+
+      /* DONE may reuse its request, so advance first. */
+      for (e = list_begin (&r->merged); e != list_end (&r->merged); )
+        {
+          struct block_request *m = list_entry (e, struct block_request,
+                                                merge_elem);
+          e = list_next (e);
+          m->done (m);
+        }
+      lock_acquire (&block->queue_lock);
+      block->busy = false;
+    }
+}
+
+/* FIFO: requests are served in the order they arrive. */
+static struct block_request *
+fifo_next (struct block *block)
+{
+  return list_entry (list_front (&block->fifo), struct block_request,
+                     fifo_elem);
+}
+
+static const struct block_scheduler fifo_scheduler = {"fifo", fifo_next};
+
+/* C-LOOK: the disk arm sweeps toward higher sectors, serving the
+   nearest request at or past it, then jumps back to the lowest
+   queued sector. */
+static struct block_request *
+clook_next (struct block *block)
+{
+  struct list_elem *e;
+
+  for (e = list_begin (&block->sorted); e != list_end (&block->sorted);
+       e = list_next (e))
+    {
+      struct block_request *r = list_entry (e, struct block_request,
+                                            sorted_elem);
+      if (r->start >= block->head)
+        return r;
+    }
+  return list_entry (list_front (&block->sorted), struct block_request,
+                     sorted_elem);
+}
+
+static const struct block_scheduler clook_scheduler = {"clook", clook_next};
+
+/* Deadline: C-LOOK, except that a request whose deadline has
+   passed is served first.  Reads expire sooner than writes,
+   since someone is usually waiting for them. */
+static struct block_request *
+deadline_next (struct block *block)
+{
+  int64_t now = timer_ticks ();
+  struct list_elem *e;
+
+  for (e = list_begin (&block->fifo); e != list_end (&block->fifo);
+       e = list_next (e))
+    {
+      struct block_request *r = list_entry (e, struct block_request,
+                                            fifo_elem);
+      if (r->deadline <= now)
+        return r;
+    }
+  return clook_next (block);
+}
+
+static const struct block_scheduler deadline_scheduler =
+  {"deadline", deadline_next};
+
+/* Selects the I/O scheduler named NAME ("fifo", "clook" or
+   "deadline").  Returns false if there is no such scheduler. */
+bool
+block_set_scheduler (const char *name)
+{
+  size_t i;
+
+  for (i = 0; i < sizeof schedulers / sizeof *schedulers; i++)
+    if (!strcmp (name, schedulers[i]->name))
+      {
+        scheduler = schedulers[i];
+        return true;
+      }
+  return false;
 }
 
 /* Returns the number of sectors in BLOCK. */
@@ -174,6 +574,10 @@ block_print_stats (void)
           printf ("%s (%s): %llu reads, %llu writes\n",
                   block->name, block_type_name (block->type),
                   block->read_cnt, block->write_cnt);
+          if (block->merge_cnt > 0)
+            printf ("%s (%s): %llu requests merged\n",
+                    block->name, block_type_name (block->type),
+                    block->merge_cnt);
         }
     }
 }
@@ -198,8 +602,18 @@ block_register (const char *name, enum block_type type,
   block->size = size;
   block->ops = ops;
   block->aux = aux;
+  block->lower = NULL;
+  block->lower_start = 0;
+  lock_init (&block->queue_lock);
+  cond_init (&block->queue_ready);
+  list_init (&block->sorted);
+  list_init (&block->fifo);
+  block->head = 0;
+  block->worker_started = false;
+  block->busy = false;
   block->read_cnt = 0;
   block->write_cnt = 0;
+  block->merge_cnt = 0;
 
   printf ("%s: %'"PRDSNu" sectors (", block->name, block->size);
   print_human_readable_size ((uint64_t) block->size * BLOCK_SECTOR_SIZE);
@@ -211,6 +625,16 @@ block_register (const char *name, enum block_type type,
   return block;
 }
 
+/* Makes BLOCK, which is part of LOWER starting at sector START,
+   send its requests to LOWER's queue, e.g. for a partition. */
+void
+block_set_lower (struct block *block, struct block *lower,
+                 block_sector_t start)
+{
+  block->lower = lower;
+  block->lower_start = start;
+}
+
 /* Returns the block device corresponding to LIST_ELEM, or a null
    pointer if LIST_ELEM is the list end of all_blocks. */
 static struct block *
@@ -3,6 +3,8 @@
 
 #include <stddef.h>
 #include <inttypes.h>
+#include <stdbool.h>
+#include <list.h>
 
 /* Size of a block device sector in bytes.
    All IDE disks use this sector size, as do most USB and SCSI
@@ -53,22 +55,69 @@ struct block *block_next (struct block *);
 block_sector_t block_size (struct block *);
 void block_read (struct block *, block_sector_t, void *);
 void block_write (struct block *, block_sector_t, const void *);
+void block_read_multiple (struct block *, block_sector_t, size_t cnt,
+                          void *const buffers[]);
+void block_write_multiple (struct block *, block_sector_t, size_t cnt,
+                           const void *const buffers[]);
 const char *block_name (struct block *);
 enum block_type block_type (struct block *);
 
+/* Asynchronous requests.
+
+   Each block device has a queue of requests, served one at a
+   time by a kernel thread in the order chosen by the I/O
+   scheduler.  A request for sectors right before or after those
+   of a queued request in the same direction is merged into it,
+   so both move in one transfer.  Requests for overlapping sectors
+   may complete in any order; callers must order them. */
+struct block_request
+  {
+    /* Filled in by the submitter, who must keep the request and
+       its buffers alive until DONE is called. */
+    block_sector_t sector;              /* First sector. */
+    size_t cnt;                         /* Number of sectors. */
+    bool write;                         /* Write, not read? */
+    void *const *buffers;               /* CNT sector buffers. */
+    void (*done) (struct block_request *); /* Called when complete. */
+    void *aux;                          /* For DONE's use. */
+
+    /* Owned by the block layer while the request is queued. */
+    struct list_elem sorted_elem;       /* In queue, by sector. */
+    struct list_elem fifo_elem;         /* In queue, by arrival. */
+    struct list_elem merge_elem;        /* In the merged list. */
+    struct list merged;                 /* Requests moved with this one. */
+    block_sector_t start;               /* First sector of all merged. */
+    size_t total;                       /* Sectors in all merged. */
+    int64_t deadline;                   /* Tick to be served by. */
+  };
+
+void block_submit (struct block *, struct block_request *);
+void block_submit_wait (struct block *, struct block_request *);
+bool block_set_scheduler (const char *name);
+
 /* Statistics. */
 void block_print_stats (void);
 
 /* Lower-level interface to block device drivers. */
 
+/* READ_MULTIPLE and WRITE_MULTIPLE transfer CNT consecutive
+   sectors, the Nth of them to or from BUFFERS[N].  They may be
+   null, in which case the block layer falls back to READ and
+   WRITE one sector at a time. */
 struct block_operations
   {
     void (*read) (void *aux, block_sector_t, void *buffer);
     void (*write) (void *aux, block_sector_t, const void *buffer);
+    void (*read_multiple) (void *aux, block_sector_t, size_t cnt,
+                           void *const buffers[]);
+    void (*write_multiple) (void *aux, block_sector_t, size_t cnt,
+                            const void *const buffers[]);
   };
 
 struct block *block_register (const char *name, enum block_type,
                               const char *extra_info, block_sector_t size,
                               const struct block_operations *, void *aux);
+void block_set_lower (struct block *, struct block *lower,
+                      block_sector_t start);
 
 #endif /* devices/block.h */
@@ -3,12 +3,15 @@
 #include <debug.h>
 #include <stdbool.h>
 #include <stdio.h>
+#include <string.h>
 #include "devices/block.h"
 #include "devices/partition.h"
 #include "devices/timer.h"
 #include "threads/io.h"
 #include "threads/interrupt.h"
+#include "threads/palloc.h"
 #include "threads/synch.h"
+#include "threads/vaddr.h"
 
 /* The code in this file is an interface to an ATA (IDE)
    controller.  It attempts to comply to [ATA-3]. */
@@ -24,6 +27,12 @@
 #define reg_status(CHANNEL) ((CHANNEL)->reg_base + 7)   /* Status (r/o). */
 #define reg_command(CHANNEL) reg_status (CHANNEL)       /* Command (w/o). */
 
+/* Bus master IDE port addresses, relative to the channel's base
+   taken from the controller's PCI BAR4. */
+#define reg_bm_command(CHANNEL) ((CHANNEL)->bm_base + 0) /* Command. */
+#define reg_bm_status(CHANNEL) ((CHANNEL)->bm_base + 2)  /* Status. */
+#define reg_bm_prdt(CHANNEL) ((CHANNEL)->bm_base + 4)    /* PRD table. */
+
 /* ATA control block port addresses.
    (If we supported non-legacy ATA controllers this would not be
    flexible enough, but it's fine for what we do.) */
@@ -34,6 +43,16 @@
 #define STA_BSY 0x80            /* Busy. */
 #define STA_DRDY 0x40           /* Device Ready. */
 #define STA_DRQ 0x08            /* Data Request. */
+#define STA_ERR 0x01            /* Error. */
+
+/* Bus Master Command Register bits. */
+#define BM_CMD_START 0x01       /* Start transfer. */
+#define BM_CMD_READ 0x08        /* Transfer to memory (a disk read). */
+
+/* Bus Master Status Register bits.  Writing 1 clears ERR and
+   INTR. */
+#define BM_STA_ERR 0x02         /* Transfer failed. */
+#define BM_STA_INTR 0x04        /* Device interrupted. */
 
 /* Control Register bits. */
 #define CTL_SRST 0x04           /* Software Reset. */
@@ -49,6 +68,19 @@
 #define CMD_IDENTIFY_DEVICE 0xec        /* IDENTIFY DEVICE. */
 #define CMD_READ_SECTOR_RETRY 0x20      /* READ SECTOR with retries. */
 #define CMD_WRITE_SECTOR_RETRY 0x30     /* WRITE SECTOR with retries. */
+#define CMD_READ_MULTIPLE 0xc4          /* READ MULTIPLE. */
+#define CMD_WRITE_MULTIPLE 0xc5         /* WRITE MULTIPLE. */
+#define CMD_SET_MULTIPLE_MODE 0xc6      /* SET MULTIPLE MODE. */
+#define CMD_READ_DMA 0xc8               /* READ DMA. */
+#define CMD_WRITE_DMA 0xca              /* WRITE DMA. */
+
+/* PCI configuration space access ports. */
+#define PCI_CONFIG_ADDR 0xcf8
+#define PCI_CONFIG_DATA 0xcfc
+
+/* Most sectors moved by a single command.  A sector count of 0
+   in reg_nsect means 256. */
+#define MAX_COMMAND_SECTORS 256
 
 /* An ATA device. */
 struct ata_disk
@@ -57,8 +89,24 @@ struct ata_disk
     struct channel *channel;    /* Channel that disk is attached to. */
     int dev_no;                 /* Device 0 or 1 for master or slave. */
     bool is_ata;                /* Is device an ATA disk? */
+    int multiple;               /* Sectors per interrupt with READ/WRITE
+                                   MULTIPLE, or 0 if not enabled. */
+    bool dma;                   /* Does the disk support DMA? */
+  };
+
+/* A bus master Physical Region Descriptor, which describes one
+   physically contiguous piece of a DMA transfer.  A region may
+   not cross a 64 kB boundary, and a size of 0 means 64 kB. */
+struct prd
+  {
+    uint32_t addr;              /* Physical address. */
+    uint16_t size;              /* Size in bytes. */
+    uint16_t flags;             /* PRD_EOT on the last descriptor. */
   };
 
+#define PRD_EOT 0x8000          /* End of table. */
+#define PRD_BOUNDARY 0x10000    /* Regions may not cross this. */
+
 /* An ATA channel (aka controller).
    Each channel can control up to two disks. */
 struct channel
@@ -72,6 +120,10 @@ struct channel
                                    any interrupt would be spurious. */
     struct semaphore completion_wait;   /* Up'd by interrupt handler. */
 
+    uint16_t bm_base;           /* Bus master base port, 0 if none. */
+    bool use_dma;               /* Transfer by DMA instead of PIO? */
+    struct prd *prdt;           /* Page holding the PRD table. */
+
     struct ata_disk devices[2];     /* The devices on this channel. */
   };
 
@@ -85,7 +137,11 @@ static void reset_channel (struct channel *);
 static bool check_device_type (struct ata_disk *);
 static void identify_ata_device (struct ata_disk *);
 
-static void select_sector (struct ata_disk *, block_sector_t);
+static uint16_t find_bus_master (void);
+static void set_multiple_mode (struct ata_disk *, const char *id);
+static void dma_transfer (struct ata_disk *, block_sector_t, size_t cnt,
+                          const void *const buffers[], bool write);
+static void select_sector (struct ata_disk *, block_sector_t, size_t cnt);
 static void issue_pio_command (struct channel *, uint8_t command);
 static void input_sector (struct channel *, void *);
 static void output_sector (struct channel *, const void *);
@@ -97,10 +153,58 @@ static void select_device_wait (const struct ata_disk *);
 
 static void interrupt_handler (struct intr_frame *);
 
+/* Channels that may use DMA, as a bit mask, set by "-ide-dma". */
+static unsigned dma_channels = (1u << CHANNEL_CNT) - 1;
+
+/* Selects the channels that use bus master DMA when the hardware
+   allows: CHANNELS is a comma-separated list of channel numbers,
+   or "none" for PIO only.  Must be called before ide_init().
+   Returns false if CHANNELS is malformed. */
+bool
+ide_configure_dma (const char *channels)
+{
+  unsigned mask = 0;
+
+  if (strcmp (channels, "none"))
+    {
+      for (; *channels != '\0'; channels++)
+        if (*channels >= '0' && *channels < '0' + CHANNEL_CNT)
+          mask |= 1u << (*channels - '0');
+        else if (*channels != ',')
+          return false;
+    }
+  dma_channels = mask;
+  return true;
+}
+
+/* Turns DMA on or off for every channel that was allowed to use
+   it and whose controller supports it.  Returns false if there is
+   no such channel. */
+bool
+ide_set_dma (bool enable)
+{
+  bool any = false;
+  size_t chan_no;
+
+  for (chan_no = 0; chan_no < CHANNEL_CNT; chan_no++)
+    {
+      struct channel *c = &channels[chan_no];
+      if (c->prdt != NULL)
+        {
+          lock_acquire (&c->lock);
+          c->use_dma = enable;
+          lock_release (&c->lock);
+          any = true;
+        }
+    }
+  return any;
+}
+
 /* Initialize the disk subsystem and detect disks. */
 void
 ide_init (void) 
 {
+  uint16_t bm_base = find_bus_master ();
   size_t chan_no;
 
   for (chan_no = 0; chan_no < CHANNEL_CNT; chan_no++)
@@ -126,6 +230,20 @@ ide_init (void)
       lock_init (&c->lock);
       c->expecting_interrupt = false;
       sema_init (&c->completion_wait, 0);
+
+      /* Set up bus master DMA, if we may and can. */
+      c->bm_base = 0;
+      c->use_dma = false;
+      c->prdt = NULL;
+      if (bm_base != 0 && (dma_channels & (1u << chan_no)))
+        {
+          c->prdt = palloc_get_page (0);
+          if (c->prdt != NULL)
+            {
+              c->bm_base = bm_base + 8 * chan_no;
+              c->use_dma = true;
+            }
+        }
  
       /* Initialize devices. */
       for (dev_no = 0; dev_no < 2; dev_no++)
@@ -136,6 +254,8 @@ ide_init (void)
           d->channel = c;
           d->dev_no = dev_no;
           d->is_ata = false;
+          d->multiple = 0;
+          d->dma = false;
         }
 
       /* Register interrupt handler. */
@@ -303,12 +423,100 @@ identify_ata_device (struct ata_disk *d)
       return;
     }
 
+  set_multiple_mode (d, id);
+  d->dma = (*(uint16_t *) &id[49 * 2] & 0x100) != 0;
+  if (d->dma && c->use_dma)
+    strlcat (extra_info, ", DMA", sizeof extra_info);
+
   /* Register. */
   block = block_register (d->name, BLOCK_RAW, extra_info, capacity,
                           &ide_operations, d);
   partition_scan (block);
 }
 
+/* Reads the 32-bit register REG from the PCI configuration space
+   of function FUNC of device DEV on bus BUS. */
+static uint32_t
+pci_read_config (int bus, int dev, int func, int reg)
+{
+  outl (PCI_CONFIG_ADDR,
+        0x80000000 | (bus << 16) | (dev << 11) | (func << 8) | (reg & 0xfc));
+  return inl (PCI_CONFIG_DATA);
+}
+
+/* Writes VALUE to the 32-bit register REG in the PCI
+   configuration space of function FUNC of device DEV on bus
+   BUS. */
+static void
+pci_write_config (int bus, int dev, int func, int reg, uint32_t value)
+{
+  outl (PCI_CONFIG_ADDR,
+        0x80000000 | (bus << 16) | (dev << 11) | (func << 8) | (reg & 0xfc));
+  outl (PCI_CONFIG_DATA, value);
+}
+
+/* Looks on PCI bus 0 for an IDE controller that drives the legacy
+   channels and can act as bus master, as QEMU's PIIX does.
+   Enables bus mastering on it and returns the I/O port base of its
+   bus master registers, or 0 if there is no such controller. */
+static uint16_t
+find_bus_master (void)
+{
+  int dev, func;
+
+  for (dev = 0; dev < 32; dev++)
+    for (func = 0; func < 8; func++)
+      {
+        uint32_t class = pci_read_config (0, dev, func, 0x08);
+        uint32_t bar4, command;
+
+        if ((pci_read_config (0, dev, func, 0x00) & 0xffff) == 0xffff)
+          continue;
+
+        /* Mass storage (01), IDE (01), bus master capable (prog-if
+           bit 7), both channels in compatibility mode (prog-if bits
+           0 and 2 clear). */
+        if ((class >> 16) != 0x0101 || !(class & 0x8000) || (class & 0x0500))
+          continue;
+        bar4 = pci_read_config (0, dev, func, 0x20);
+        if (!(bar4 & 1) || (bar4 & 0xfffc) == 0)
+          continue;
+
+        /* Enable I/O space and bus mastering.  Writing zeros to the
+           status half leaves it alone. */
+        command = pci_read_config (0, dev, func, 0x04) & 0xffff;
+        pci_write_config (0, dev, func, 0x04, command | 0x5);
+        return bar4 & 0xfffc;
+      }
+  return 0;
+}
+
+/* Enables READ/WRITE MULTIPLE on disk D, whose IDENTIFY DEVICE
+   data is ID, with the largest number of sectors per interrupt
+   that D supports.  Leaves D's multiple member 0 if D does not
+   support them or refuses. */
+static void
+set_multiple_mode (struct ata_disk *d, const char *id)
+{
+  struct channel *c = d->channel;
+  int max = (uint8_t) id[47 * 2];
+  int sectors;
+
+  d->multiple = 0;
+  if (max == 0)
+    return;
+  for (sectors = 1; sectors * 2 <= max; sectors *= 2)
+    continue;
+
+  select_device_wait (d);
+  outb (reg_nsect (c), sectors);
+  issue_pio_command (c, CMD_SET_MULTIPLE_MODE);
+  sema_down (&c->completion_wait);
+  wait_while_busy (d);
+  if ((inb (reg_alt_status (c)) & STA_ERR) == 0)
+    d->multiple = sectors;
+}
+
 /* Translates STRING, which consists of SIZE bytes in a funky
    format, into a null-terminated string in-place.  Drops
    trailing whitespace and null bytes.  Returns STRING.  */
@@ -341,19 +549,15 @@ descramble_ata_string (char *string, int size)
    room for BLOCK_SECTOR_SIZE bytes.
    Internally synchronizes accesses to disks, so external
    per-disk locking is unneeded. */
+static void ide_read_multiple (void *, block_sector_t, size_t,
+                               void *const buffers[]);
+static void ide_write_multiple (void *, block_sector_t, size_t,
+                                const void *const buffers[]);
+
 static void
 ide_read (void *d_, block_sector_t sec_no, void *buffer)
 {
-  struct ata_disk *d = d_;
-  struct channel *c = d->channel;
-  lock_acquire (&c->lock);
-  select_sector (d, sec_no);
-  issue_pio_command (c, CMD_READ_SECTOR_RETRY);
-  sema_down (&c->completion_wait);
-  if (!wait_while_busy (d))
-    PANIC ("%s: disk read failed, sector=%"PRDSNu, d->name, sec_no);
-  input_sector (c, buffer);
-  lock_release (&c->lock);
+  ide_read_multiple (d_, sec_no, 1, &buffer);
 }
 
 /* Write sector SEC_NO to disk D from BUFFER, which must contain
@@ -363,37 +567,202 @@ ide_read (void *d_, block_sector_t sec_no, void *buffer)
    per-disk locking is unneeded. */
 static void
 ide_write (void *d_, block_sector_t sec_no, const void *buffer)
+{
+  ide_write_multiple (d_, sec_no, 1, &buffer);
+}
+
+/* Reads the CNT sectors starting at SEC_NO from disk D, the Nth
+   of them into BUFFERS[N].  Each command moves up to
+   MAX_COMMAND_SECTORS sectors, and with READ MULTIPLE enabled the
+   disk interrupts once per D->multiple sectors instead of once
+   per sector.  If the channel and disk support DMA, the disk
+   moves the data itself and interrupts once per command.
+   Internally synchronizes accesses to disks, so external
+   per-disk locking is unneeded. */
+static void
+ide_read_multiple (void *d_, block_sector_t sec_no, size_t cnt,
+                   void *const buffers[])
 {
   struct ata_disk *d = d_;
   struct channel *c = d->channel;
+  size_t per_intr = d->multiple > 0 ? (size_t) d->multiple : 1;
+
   lock_acquire (&c->lock);
-  select_sector (d, sec_no);
-  issue_pio_command (c, CMD_WRITE_SECTOR_RETRY);
-  if (!wait_while_busy (d))
-    PANIC ("%s: disk write failed, sector=%"PRDSNu, d->name, sec_no);
-  output_sector (c, buffer);
-  sema_down (&c->completion_wait);
+  while (cnt > 0)
+    {
+      size_t n = cnt < MAX_COMMAND_SECTORS ? cnt : MAX_COMMAND_SECTORS;
+      size_t done = 0;
+
+      if (c->use_dma && d->dma)
+        {
+          dma_transfer (d, sec_no, n, (const void *const *) buffers, false);
+          done = n;
+        }
+      else
+        {
+          select_sector (d, sec_no, n);
+          issue_pio_command (c, (d->multiple > 0 ? CMD_READ_MULTIPLE
+                                 : CMD_READ_SECTOR_RETRY));
+        }
+      while (done < n)
+        {
+          size_t i;
+
+          sema_down (&c->completion_wait);
+          if (!wait_while_busy (d))
+            PANIC ("%s: disk read failed, sector=%"PRDSNu,
+                   d->name, sec_no + done);
+          for (i = 0; i < per_intr && done < n; i++, done++)
+            input_sector (c, buffers[done]);
+        }
+      sec_no += n;
+      buffers += n;
+      cnt -= n;
+    }
+  lock_release (&c->lock);
+}
+
+/* Writes the CNT sectors starting at SEC_NO to disk D, the Nth of
+   them from BUFFERS[N].  Returns after the disk has acknowledged
+   receiving all the data.  Batches sectors per command and per
+   interrupt as ide_read_multiple() does.
+   Internally synchronizes accesses to disks, so external
+   per-disk locking is unneeded. */
+static void
+ide_write_multiple (void *d_, block_sector_t sec_no, size_t cnt,
+                    const void *const buffers[])
+{
+  struct ata_disk *d = d_;
+  struct channel *c = d->channel;
+  size_t per_intr = d->multiple > 0 ? (size_t) d->multiple : 1;
+
+  lock_acquire (&c->lock);
+  while (cnt > 0)
+    {
+      size_t n = cnt < MAX_COMMAND_SECTORS ? cnt : MAX_COMMAND_SECTORS;
+      size_t done = 0;
+
+      if (c->use_dma && d->dma)
+        {
+          dma_transfer (d, sec_no, n, buffers, true);
+          done = n;
+        }
+      else
+        {
+          select_sector (d, sec_no, n);
+          issue_pio_command (c, (d->multiple > 0 ? CMD_WRITE_MULTIPLE
+                                 : CMD_WRITE_SECTOR_RETRY));
+        }
+      while (done < n)
+        {
+          size_t i;
+
+          if (!wait_while_busy (d))
+            PANIC ("%s: disk write failed, sector=%"PRDSNu,
+                   d->name, sec_no + done);
+          for (i = 0; i < per_intr && done < n; i++, done++)
+            output_sector (c, buffers[done]);
+          sema_down (&c->completion_wait);
+        }
+      sec_no += n;
+      buffers += n;
+      cnt -= n;
+    }
   lock_release (&c->lock);
 }
 
+/* Fills channel C's PRD table to describe the CNT sector buffers
+   in BUFFERS, merging buffers that are physically adjacent. */
+static void
+build_prdt (struct channel *c, size_t cnt, const void *const buffers[])
+{
+  struct prd *prd = NULL;
+  size_t i;
+
+  for (i = 0; i < cnt; i++)
+    {
+      uintptr_t addr = vtop (buffers[i]);
+      size_t left = BLOCK_SECTOR_SIZE;
+
+      while (left > 0)
+        {
+          size_t size = PRD_BOUNDARY - addr % PRD_BOUNDARY;
+          if (size > left)
+            size = left;
+
+          if (prd != NULL
+              && prd->addr + prd->size == addr
+              && prd->addr / PRD_BOUNDARY == addr / PRD_BOUNDARY
+              && prd->size != 0)
+            prd->size += size;
+          else
+            {
+              prd = prd == NULL ? c->prdt : prd + 1;
+              ASSERT ((uint8_t *) (prd + 1) <= (uint8_t *) c->prdt + PGSIZE);
+              prd->addr = addr;
+              prd->size = size;
+              prd->flags = 0;
+            }
+          addr += size;
+          left -= size;
+        }
+    }
+  prd->flags = PRD_EOT;
+}
+
+/* Moves the CNT sectors starting at SEC_NO between disk D and
+   BUFFERS by bus master DMA, to the disk if WRITE.  CNT must be
+   at most MAX_COMMAND_SECTORS.  Must be called with D's channel
+   locked. */
+static void
+dma_transfer (struct ata_disk *d, block_sector_t sec_no, size_t cnt,
+              const void *const buffers[], bool write)
+{
+  struct channel *c = d->channel;
+  uint8_t direction = write ? 0 : BM_CMD_READ;
+  uint8_t bm_status;
+
+  build_prdt (c, cnt, buffers);
+  outl (reg_bm_prdt (c), vtop (c->prdt));
+  outb (reg_bm_command (c), direction);
+  outb (reg_bm_status (c),
+        inb (reg_bm_status (c)) | BM_STA_ERR | BM_STA_INTR);
+
+  select_sector (d, sec_no, cnt);
+  issue_pio_command (c, write ? CMD_WRITE_DMA : CMD_READ_DMA);
+  outb (reg_bm_command (c), direction | BM_CMD_START);
+  sema_down (&c->completion_wait);
+  outb (reg_bm_command (c), direction);
+
+  bm_status = inb (reg_bm_status (c));
+  outb (reg_bm_status (c), bm_status | BM_STA_ERR | BM_STA_INTR);
+  if ((bm_status & BM_STA_ERR) || (inb (reg_alt_status (c)) & STA_ERR))
+    PANIC ("%s: DMA %s failed, sector=%"PRDSNu,
+           d->name, write ? "write" : "read", sec_no);
+}
+
 static struct block_operations ide_operations =
   {
     ide_read,
-    ide_write
+    ide_write,
+    ide_read_multiple,
+    ide_write_multiple
   };
 
 /* Selects device D, waiting for it to become ready, and then
-   writes SEC_NO to the disk's sector selection registers.  (We
-   use LBA mode.) */
+   writes SEC_NO and the sector count CNT, which must be between 1
+   and MAX_COMMAND_SECTORS, to the disk's sector selection
+   registers.  (We use LBA mode.) */
 static void
-select_sector (struct ata_disk *d, block_sector_t sec_no)
+select_sector (struct ata_disk *d, block_sector_t sec_no, size_t cnt)
 {
   struct channel *c = d->channel;
 
   ASSERT (sec_no < (1UL << 28));
+  ASSERT (cnt >= 1 && cnt <= MAX_COMMAND_SECTORS);
   
   select_device_wait (d);
-  outb (reg_nsect (c), 1);
+  outb (reg_nsect (c), cnt % MAX_COMMAND_SECTORS);
   outb (reg_lbal (c), sec_no);
   outb (reg_lbam (c), sec_no >> 8);
   outb (reg_lbah (c), (sec_no >> 16));
@@ -402,7 +771,7 @@ select_sector (struct ata_disk *d, block_sector_t sec_no)
 }
 
 /* Writes COMMAND to channel C and prepares for receiving a
-   completion interrupt. */
+   completion interrupt.  Used for DMA commands too. */
 static void
 issue_pio_command (struct channel *c, uint8_t command) 
 {
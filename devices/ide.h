@@ -1,6 +1,10 @@
 #ifndef DEVICES_IDE_H
 #define DEVICES_IDE_H
 
+#include <stdbool.h>
+
 void ide_init (void);
+bool ide_configure_dma (const char *channels);
+bool ide_set_dma (bool enable);
 
 #endif /* devices/ide.h */
@@ -1,261 +1,1219 @@
 #include "filesys/cache.h"
+#include <round.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include "filesys/filesys.h"
-#include "threads/malloc.h"
+#include "threads/palloc.h"
 #include "threads/thread.h"
+#include "threads/vaddr.h"
 
 void
 thread_func_read_ahead (void *aux);
-struct cache_block*
-read_block_from_disk (block_sector_t sector, bool dirty);
 void
 thread_func_flush_back (void *aux);
-struct cache_block* 
-cache_block_evict (block_sector_t sector, bool dirty);
+void
+thread_func_flush_timer (void *aux);
+static struct cache_block *
+cache_block_fetch (block_sector_t sector, unsigned flags);
+static struct cache_block *
+cache_evict_prefetched (struct cache_shard *s);
+static void
+cache_block_wait (struct cache_block *c, bool exclusive);
+static void
+cache_shard_reset (struct cache_shard *s);
+static unsigned cache_block_hash (const struct hash_elem *e, void *aux);
+static bool cache_block_less (const struct hash_elem *a,
+                              const struct hash_elem *b, void *aux);
+static unsigned cache_ghost_hash (const struct hash_elem *e, void *aux);
+static bool cache_ghost_less (const struct hash_elem *a,
+                              const struct hash_elem *b, void *aux);
+static void queue_remove (struct cache_shard *s, struct cache_block *c);
+static void cache_mark_dirty (struct cache_shard *s, struct cache_block *c);
+static void cache_mark_clean (struct cache_shard *s, struct cache_block *c);
+static void cache_throttle (void);
+
+static const struct cache_policy clock_policy, twoq_policy, arc_policy;
+
+/* Replacement policies that can be chosen with "-cache-policy". */
+static const struct cache_policy *const cache_policies[] =
+  {&clock_policy, &twoq_policy, &arc_policy};
+
+/* Policy in use. */
+static const struct cache_policy *cache_policy = &clock_policy;
+
+/* cache_block_fetch() flag for read-ahead, in addition to the
+   public CACHE_* flags. */
+#define CACHE_PREFETCH 0x8
+
+/* Most sectors cache_zero() writes in one transfer. */
+#define ZERO_RUN_MAX 128
+
+/* A sector of zeros, and a vector of pointers to it. */
+static char zeros[BLOCK_SECTOR_SIZE];
+static const void *zero_sectors[ZERO_RUN_MAX];
+
+/* Number of sectors to cache, set by "-cache=N". */
+static size_t cache_block_cnt = CACHE_AMOUNT;
+
+/* The preallocated pool, CACHE_BLOCK_CNT entries of each. */
+static struct cache_block *cache_blocks;
+static struct cache_ghost *cache_ghosts;
+
+/*
+ * Pending read-ahead requests, a ring of sectors consumed by the
+ * single read-ahead thread.  When it is full, new requests are
+ * dropped: read-ahead is only a hint.  READ_AHEAD_BUSY is set while
+ * the thread brings READ_AHEAD_CURRENT into the cache, and
+ * READ_AHEAD_IDLE is signaled when it is done.
+ */
+static block_sector_t read_ahead_queue[READ_AHEAD_QUEUE];
+static size_t read_ahead_head, read_ahead_cnt;
+static block_sector_t read_ahead_current;
+static bool read_ahead_busy;
+static struct lock read_ahead_lock;
+static struct condition read_ahead_ready, read_ahead_idle;
+
+/* Dirty-block thresholds, in blocks.  Past DIRTY_BACKGROUND the
+   flusher is woken early; past DIRTY_LIMIT writers also wait for
+   it to finish a pass.  Set as percentages by "-cache-dirty". */
+static int dirty_background_pct = CACHE_DIRTY_BACKGROUND;
+static int dirty_limit_pct = CACHE_DIRTY_LIMIT;
+static size_t dirty_background, dirty_limit;
+
+/* Flusher thread state, protected by FLUSH_LOCK.  FLUSH_PASSES
+   counts completed passes so throttled writers can wait for the
+   next one. */
+static struct lock flush_lock;
+static struct condition flush_wanted, flush_done;
+static bool flush_requested;
+static unsigned flush_passes;
+
+/* Serializes cache_flush_to_disk(), which collects the dirty
+   blocks into FLUSH_BATCH. */
+static struct lock flush_serial;
+
+/* Flush writes still in flight; the flusher waits for them. */
+static struct semaphore flush_pending;
+
+static struct cache_block **flush_batch;
+
+/*
+ *  Sets the number of sectors the cache holds, which must be
+ *  called before cache_init().  At least one block per shard is
+ *  always kept.
+ */
+void
+cache_configure (size_t block_cnt)
+{
+    cache_block_cnt = block_cnt < CACHE_SHARDS ? CACHE_SHARDS : block_cnt;
+}
 
+/*
+ *  Sets the dirty-block thresholds, as percentages of the cache:
+ *  past BACKGROUND the flusher starts early, past LIMIT writers
+ *  are throttled.  Must be called before cache_init().
+ */
+void
+cache_configure_dirty (int background, int limit)
+{
+    dirty_background_pct = background;
+    dirty_limit_pct = limit > background ? limit : background;
+}
 
+/*
+ *  Selects the replacement policy named NAME ("clock", "2q" or
+ *  "arc"), which must be done before cache_init().  Returns false
+ *  if there is no such policy.
+ */
+bool
+cache_set_policy (const char *name)
+{
+    size_t i;
+    for (i = 0; i < sizeof cache_policies / sizeof *cache_policies; i++)
+        if (!strcmp (name, cache_policies[i]->name))
+        {
+            cache_policy = cache_policies[i];
+            return true;
+        }
+    return false;
+}
 
 /*
- *  Initialize all the cache related struct
+ *  Initialize all the cache related struct.  The whole pool is
+ *  preallocated here, so memory use is fixed from boot on.  Each
+ *  shard also gets one ghost entry per block it owns.
  */
 void
 cache_init (void)
 {
-    list_init (&cache);
-    lock_init (&cache_lock);
-    cache_size = 0;         
+    size_t meta_pages = DIV_ROUND_UP (cache_block_cnt * sizeof (struct cache_block),
+                                      PGSIZE);
+    size_t ghost_pages = DIV_ROUND_UP (cache_block_cnt * sizeof (struct cache_ghost),
+                                       PGSIZE);
+    size_t batch_pages = DIV_ROUND_UP (cache_block_cnt * sizeof *flush_batch,
+                                       PGSIZE);
+    size_t data_pages = DIV_ROUND_UP (cache_block_cnt * BLOCK_SECTOR_SIZE, PGSIZE);
+    uint8_t *data;
+    size_t i;
+
+    cache_blocks = palloc_get_multiple (PAL_ZERO, meta_pages);
+    cache_ghosts = palloc_get_multiple (PAL_ZERO, ghost_pages);
+    flush_batch = palloc_get_multiple (0, batch_pages);
+    data = palloc_get_multiple (0, data_pages);
+    if (cache_blocks == NULL || cache_ghosts == NULL || flush_batch == NULL
+        || data == NULL)
+        PANIC ("Not enough memory for %zu-sector buffer cache", cache_block_cnt);
+
+    for (i = 0; i < ZERO_RUN_MAX; i++)
+        zero_sectors[i] = zeros;
+    for (i = 0; i < CACHE_SHARDS; i++)
+    {
+        struct cache_shard *s = &cache_shards[i];
+        lock_init (&s->lock);
+        hash_init (&s->map, cache_block_hash, cache_block_less, NULL);
+        hash_init (&s->ghost_map, cache_ghost_hash, cache_ghost_less, NULL);
+        cond_init (&s->block_free);
+        s->capacity = 0;
+        s->hits = s->misses = s->evictions = 0;
+        s->read_aheads = s->read_ahead_hits = 0;
+    }
+    for (i = 0; i < cache_block_cnt; i++)
+    {
+        struct cache_block *c = &cache_blocks[i];
+        c->shard = &cache_shards[i % CACHE_SHARDS];
+        c->block = data + i * BLOCK_SECTOR_SIZE;
+        cond_init (&c->released);
+        c->shard->capacity++;
+    }
+    for (i = 0; i < CACHE_SHARDS; i++)
+        cache_shard_reset (&cache_shards[i]);
+    lock_init (&read_ahead_lock);
+    cond_init (&read_ahead_ready);
+    cond_init (&read_ahead_idle);
+    dirty_background = cache_block_cnt * dirty_background_pct / 100;
+    dirty_limit = cache_block_cnt * dirty_limit_pct / 100;
+    lock_init (&flush_lock);
+    cond_init (&flush_wanted);
+    cond_init (&flush_done);
+    lock_init (&flush_serial);
+    sema_init (&flush_pending, 0);
     thread_create ("cache_flush_back", 0, thread_func_flush_back, NULL);
+    thread_create ("cache_flush_timer", 0, thread_func_flush_timer, NULL);
+    thread_create ("cache_read_ahead", 0, thread_func_read_ahead, NULL);
+}
+
+/*
+ *  Empties shard S: every block it owns goes back on its free list
+ *  and the replacement state is cleared.  No block may be in use.
+ */
+static void
+cache_shard_reset (struct cache_shard *s)
+{
+    size_t i;
+
+    list_init (&s->queues[0]);
+    list_init (&s->queues[1]);
+    list_init (&s->ghosts[0]);
+    list_init (&s->ghosts[1]);
+    s->queue_len[0] = s->queue_len[1] = 0;
+    s->ghost_len[0] = s->ghost_len[1] = 0;
+    s->target = 0;
+    list_init (&s->free_blocks);
+    list_init (&s->free_ghosts);
+    list_init (&s->prefetched);
+    list_init (&s->dirty);
+    s->dirty_cnt = 0;
+    hash_clear (&s->map, NULL);
+    hash_clear (&s->ghost_map, NULL);
+    for (i = 0; i < cache_block_cnt; i++)
+        if (cache_blocks[i].shard == s)
+        {
+            cache_blocks[i].prefetched = false;
+            cache_blocks[i].dirty = false;
+            list_push_back (&s->free_blocks, &cache_blocks[i].elem);
+            list_push_back (&s->free_ghosts, &cache_ghosts[i].elem);
+        }
+}
+
+/*
+ *  Returns the shard that caches SECTOR.
+ */
+struct cache_shard *
+cache_shard_for (block_sector_t sector)
+{
+    return &cache_shards[hash_int (sector) % CACHE_SHARDS];
 }
 
 /*
  *  To check whether or not given sector is inside
  *  current cache. if yes, return this cache block back.
+ *  Must be called with the lock of SECTOR's shard held.
  */
 struct cache_block* block_in_cache (block_sector_t sector)
 {
-    struct cache_block *block;
-    struct list_elem *e;
-    for (e = list_begin (&cache); e != list_end (&cache); e = list_next(e))
-    {
-	block = list_entry (e, struct cache_block, elem);
-  	if (block ->sector == sector)
-	   {
-		return block;
-	   }
-     }
-     return NULL;
-}	
-    
+    struct cache_shard *s = cache_shard_for (sector);
+    struct hash_elem *e;
+    s->key.sector = sector;
+    e = hash_find (&s->map, &s->key.hash_elem);
+    return e != NULL ? hash_entry (e, struct cache_block, hash_elem) : NULL;
+}
+
+/* Hashes a cache block by the sector it holds. */
+static unsigned
+cache_block_hash (const struct hash_elem *e, void *aux UNUSED)
+{
+    const struct cache_block *c = hash_entry (e, struct cache_block, hash_elem);
+    return hash_int (c->sector);
+}
+
+/* Orders cache blocks by sector number. */
+static bool
+cache_block_less (const struct hash_elem *a, const struct hash_elem *b,
+                  void *aux UNUSED)
+{
+    return hash_entry (a, struct cache_block, hash_elem)->sector
+           < hash_entry (b, struct cache_block, hash_elem)->sector;
+}
+
+/* Hashes a ghost entry by its sector. */
+static unsigned
+cache_ghost_hash (const struct hash_elem *e, void *aux UNUSED)
+{
+    const struct cache_ghost *g = hash_entry (e, struct cache_ghost, hash_elem);
+    return hash_int (g->sector);
+}
+
+/* Orders ghost entries by sector number. */
+static bool
+cache_ghost_less (const struct hash_elem *a, const struct hash_elem *b,
+                  void *aux UNUSED)
+{
+    return hash_entry (a, struct cache_ghost, hash_elem)->sector
+           < hash_entry (b, struct cache_ghost, hash_elem)->sector;
+}
+
 /*
  * When a request is made to read a block, check to see if it is
  * in the cache, and if so, use the cached data without going to disk
  * Otherwise, fetch the block from disk into the cache, evivcting an
- * older entry if neccessary.  The cache size limited no greater than
- * 64 sectors in size.\
- * 1. If there is a hit of the required block in the cache,return back
- * 2. If there is a miss, and there is cache_block available, read from disk
- * 3. If there is a miss, and the cache is full, evict one, replace it.
+ * older entry if neccessary.
+ * 1. If there is a hit of the required block in the cache, wait
+ *    until it can be held and return it.
+ * 2. If there is a miss, and the shard has a free block, use it.
+ * 3. If there is a miss, and the shard is full, let the replacement
+ *    policy pick a victim, replace it.
+ * The block comes back held exclusively if DIRTY (and is marked
+ * dirty), shared otherwise; release it with cache_block_put().
+ * The shard lock is dropped around every disk transfer.
  */
-
 struct cache_block* cache_block_get (block_sector_t sector, bool dirty)
 {
-    lock_acquire (&cache_lock);
-    struct cache_block *c = block_in_cache (sector);
-    if (c)
+    return cache_block_open (sector, dirty ? CACHE_WRITE : 0);
+}
+
+/*
+ * Like cache_block_get(), with FLAGS made of:
+ * CACHE_WRITE: hold the block exclusively and mark it dirty.
+ * CACHE_META: the sector holds file system metadata, an inode or
+ *   an indirect block, which is kept in preference to file data.
+ * CACHE_NOREAD: the caller overwrites the whole sector, so on a
+ *   miss it is not read from disk.  Needs CACHE_WRITE.
+ */
+struct cache_block *
+cache_block_open (block_sector_t sector, unsigned flags)
+{
+    ASSERT (!(flags & CACHE_NOREAD) || (flags & CACHE_WRITE));
+    if (flags & CACHE_WRITE)
+        cache_throttle ();
+    return cache_block_fetch (sector, flags);
+}
+
+/*
+ * Drops the pending read-ahead requests for the CNT sectors starting
+ * at SECTOR, and waits for the read-ahead thread if it is bringing
+ * one of them in right now.  Afterward the thread will not cache any
+ * of them unless it is asked to again.
+ */
+static void
+cache_cancel_read_ahead (block_sector_t sector, size_t cnt)
+{
+    size_t i, kept = 0;
+
+    lock_acquire (&read_ahead_lock);
+    for (i = 0; i < read_ahead_cnt; i++)
     {
-	c->open_cnt ++;
-	c->dirty |= dirty;
-	c->accessed = true;
-	lock_release (&cache_lock);
-	return c;
-     }
-     if (cache_size < CACHE_AMOUNT)
-     {
-         c = read_block_from_disk (sector, dirty);
-         lock_release (&cache_lock);
-	 return c;
-     }else{
-         c = cache_block_evict (sector, dirty);
-     }
-     lock_release (&cache_lock);
-     return c;
+        block_sector_t s = read_ahead_queue[(read_ahead_head + i)
+                                            % READ_AHEAD_QUEUE];
+        if (s - sector >= cnt)
+            read_ahead_queue[(read_ahead_head + kept++)
+                             % READ_AHEAD_QUEUE] = s;
+    }
+    read_ahead_cnt = kept;
+    while (read_ahead_busy && read_ahead_current - sector < cnt)
+        cond_wait (&read_ahead_idle, &read_ahead_lock);
+    lock_release (&read_ahead_lock);
 }
 
 /*
- * Fetch block from disk
- * Haven't do synchronization here, not sure whether ok????????? 
+ * Fills the CNT sectors starting at SECTOR, which were just
+ * allocated, with zeros.  Any cached copy of one of them, left over
+ * from an earlier owner, is zeroed in the cache; the others go
+ * straight to disk, a run of them at a time.  Read-ahead of the
+ * earlier owner's data is cancelled first, so it cannot cache the
+ * old contents behind our back.
  */
-struct cache_block* read_block_from_disk (block_sector_t sector, bool dirty)
+void
+cache_zero (block_sector_t sector, size_t cnt)
 {
-    
-//    lock_acquire (&cache_lock);
-    cache_size ++;
-    struct cache_block *c = malloc (sizeof (struct cache_block));
-    if (!c)
+    block_sector_t run_start = sector;
+    size_t run = 0;
+
+    cache_cancel_read_ahead (sector, cnt);
+    for (; cnt > 0; sector++, cnt--)
     {
-        PANIC ("Not enought memory for buffer cache");
+        struct cache_shard *s = cache_shard_for (sector);
+        bool cached;
+
+        lock_acquire (&s->lock);
+        cached = block_in_cache (sector) != NULL;
+        lock_release (&s->lock);
+        if (cached)
+        {
+            struct cache_block *c = cache_block_open (sector, CACHE_WRITE
+                                                              | CACHE_NOREAD);
+            memset (c->block, 0, BLOCK_SECTOR_SIZE);
+            cache_block_put (c);
+        }
+        else
+        {
+            if (run == 0)
+                run_start = sector;
+            if (++run < ZERO_RUN_MAX && cnt > 1)
+                continue;
+        }
+        if (run > 0)
+        {
+            block_write_multiple (fs_device, run_start, run, zero_sectors);
+            run = 0;
+        }
     }
-    c->open_cnt = 1;
-    list_push_back (&cache, &c->elem);
-    c->sector = sector;
-    block_read (fs_device, c->sector, &c->block);
-    c->dirty = dirty;
-    c->accessed = true;
-//    lock_release (&cache_lock);
-    return c;
 }
 
 /*
- * Instead of reading from disk directly, due to the limit of cache size,
- * it is neccessay to evict one cache block using clock algorithm, and then
- * fetch the block.
+ * Queues the transfer of block C to or from disk, without waiting.
+ * DONE is called once it is complete.
+ */
+static void
+cache_block_submit (struct cache_block *c, bool write,
+                    void (*done) (struct block_request *))
+{
+    c->io.sector = c->sector;
+    c->io.cnt = 1;
+    c->io.write = write;
+    c->io.buffers = (void *const *) &c->block;
+    c->io.done = done;
+    c->io.aux = c;
+    block_submit (fs_device, &c->io);
+}
+
+/*
+ * Completes a read-ahead started by cache_block_fetch().
  */
-struct cache_block* cache_block_evict (block_sector_t sector, bool dirty)
+static void
+cache_prefetch_done (struct block_request *r)
 {
+    struct cache_block *c = r->aux;
+    struct cache_shard *s = c->shard;
+
+    lock_acquire (&s->lock);
+    c->io_busy = false;
+    cond_broadcast (&c->released, &s->lock);
+    c->open_cnt--;
+    if (c->open_cnt == 0)
+        cond_signal (&s->block_free, &s->lock);
+    lock_release (&s->lock);
+}
 
+/*
+ * Does the work of cache_block_open().  With CACHE_PREFETCH, SECTOR
+ * is only brought into the cache, marked prefetched, and NULL is
+ * returned; nothing is done if it is cached already or every block
+ * is pinned.
+ */
+static struct cache_block *
+cache_block_fetch (block_sector_t sector, unsigned flags)
+{
+    struct cache_shard *s = cache_shard_for (sector);
     struct cache_block *c;
-/*    if (cache_size < MAX_CACHE_SIZE)
+    bool dirty = (flags & CACHE_WRITE) != 0;
+    bool prefetch = (flags & CACHE_PREFETCH) != 0;
+    bool indexed;
+
+    lock_acquire (&s->lock);
+ retry:
+    c = block_in_cache (sector);
+    if (c && prefetch)
     {
-        cache_size++;
-        c = malloc (sizeof (struct cache_block));
-        if (!c)
+        lock_release (&s->lock);
+        return NULL;
+    }
+    if (c)
+    {
+        c->open_cnt++;
+        cache_block_wait (c, dirty);
+        if (c->sector != sector)
         {
-	    return NULL;
-	}
-	c->open_cnt = 0;
-	list_push_back (&cache, &c->elem);
+            /* Evicted while we waited for it. */
+            c->open_cnt--;
+            if (c->open_cnt == 0)
+                cond_signal (&s->block_free, &s->lock);
+            goto retry;
+        }
+        s->hits++;
+        if (c->prefetched)
+        {
+            /* First real use; count it as the block's insertion. */
+            c->prefetched = false;
+            list_remove (&c->prefetch_elem);
+            s->read_ahead_hits++;
+        }
+        else
+            cache_policy->touch (s, c);
+        goto hit;
+    }
+
+    if (!list_empty (&s->free_blocks))
+    {
+        c = list_entry (list_pop_front (&s->free_blocks),
+                        struct cache_block, elem);
+        indexed = false;
     }
     else
     {
-  */    bool flag = true;
-      while (flag)
-      {
-        struct list_elem *e;
-        for (e = list_begin (&cache); e != list_end (&cache); e = list_next(e))
+        c = cache_evict_prefetched (s);
+        if (!c)
+            c = cache_policy->evict (s, sector);
+        if (!c)
         {
-		c = list_entry (e, struct cache_block, elem);
-                if (c->open_cnt > 0)
-                {
-			continue;
-		}
-		if (c->accessed)
-		{
-			c->accessed = false;
-		}
-		else
-		{
-			if (c->dirty)
-			{
-			   block_write (fs_device, c->sector, &c->block);
-			}
-		        flag = false;
-			break;
-  		}
- 	}
-      }
-   //  }
-    //pay attention to here!!!!!!!!
-    c->open_cnt++;
+            if (prefetch)
+            {
+                lock_release (&s->lock);
+                return NULL;
+            }
+            /* Every block is pinned; wait for one to be put back. */
+            cond_wait (&s->block_free, &s->lock);
+            goto retry;
+        }
+        s->evictions++;
+        indexed = true;
+    }
+    c->open_cnt = 1;
+    c->io_busy = true;
+
+    if (c->dirty)
+    {
+        /* Write the old contents back.  Lookups of the old sector
+           still find this block and wait on io_busy. */
+        cache_mark_clean (s, c);
+        lock_release (&s->lock);
+        block_write (fs_device, c->sector, c->block);
+        lock_acquire (&s->lock);
+        if (block_in_cache (sector) != NULL)
+        {
+            /* Someone else brought SECTOR in meanwhile.  Keep the
+               old, now clean, contents cached. */
+            cache_policy->insert (s, c);
+            c->io_busy = false;
+            c->open_cnt--;
+            if (c->open_cnt == 0)
+                cond_signal (&s->block_free, &s->lock);
+            else
+                cond_broadcast (&c->released, &s->lock);
+            goto retry;
+        }
+    }
+    if (indexed)
+        hash_delete (&s->map, &c->hash_elem);
     c->sector = sector;
-    block_read (fs_device, c->sector, &c->block);
-    c->dirty = dirty;
+    hash_insert (&s->map, &c->hash_elem);
+    cache_policy->insert (s, c);
+    if (prefetch)
+    {
+        c->prefetched = true;
+        list_push_back (&s->prefetched, &c->prefetch_elem);
+        s->read_aheads++;
+    }
+    else
+        s->misses++;
+
+    c->meta_chances = 0;
+    if (flags & CACHE_NOREAD)
+    {
+        /* The caller overwrites the whole sector, so there is
+           nothing to read. */
+        c->io_busy = false;
+        cond_broadcast (&c->released, &s->lock);
+    }
+    else
+    {
+        lock_release (&s->lock);
+        if (prefetch)
+        {
+            /* Let the disk queue merge and order read-ahead; the
+               block is unpinned once it arrives. */
+            cache_block_submit (c, false, cache_prefetch_done);
+            return NULL;
+        }
+        block_read (fs_device, c->sector, c->block);
+        lock_acquire (&s->lock);
+        c->io_busy = false;
+        cond_broadcast (&c->released, &s->lock);
+    }
+
+ hit:
+    if (flags & CACHE_META)
+        c->meta_chances = CACHE_META_CHANCES;
+    if (dirty)
+        c->writer = true;
+    else
+        c->readers++;
+    if (dirty)
+        cache_mark_dirty (s, c);
     c->accessed = true;
+    lock_release (&s->lock);
     return c;
 }
-    
+
+/* Marks C, of shard S, dirty.  Called with the shard lock held. */
+static void
+cache_mark_dirty (struct cache_shard *s, struct cache_block *c)
+{
+    if (!c->dirty)
+    {
+        c->dirty = true;
+        list_push_back (&s->dirty, &c->dirty_elem);
+        s->dirty_cnt++;
+    }
+}
+
+/* Marks C, of shard S, clean.  Called with the shard lock held. */
+static void
+cache_mark_clean (struct cache_shard *s, struct cache_block *c)
+{
+    if (c->dirty)
+    {
+        c->dirty = false;
+        list_remove (&c->dirty_elem);
+        s->dirty_cnt--;
+    }
+}
+
+/* Returns about how many blocks are dirty.  The shard counts are
+   read without their locks, which is fine for a threshold. */
+static size_t
+cache_dirty_count (void)
+{
+    size_t cnt = 0;
+    int i;
+    for (i = 0; i < CACHE_SHARDS; i++)
+        cnt += cache_shards[i].dirty_cnt;
+    return cnt;
+}
+
+/* Wakes the flusher thread.  Called with FLUSH_LOCK held. */
+static void
+cache_wake_flusher (void)
+{
+    flush_requested = true;
+    cond_signal (&flush_wanted, &flush_lock);
+}
 
 /*
- *  flush dirty cache block back to disk.
+ * Called before a block is taken for writing.  Past the background
+ * threshold the flusher is started; past the limit the writer also
+ * waits until the flusher completes a pass.  It waits for one pass
+ * only, so a writer is never stuck behind blocks that others keep
+ * dirty.
  */
+static void
+cache_throttle (void)
+{
+    size_t dirty = cache_dirty_count ();
+    if (dirty < dirty_background)
+        return;
+    lock_acquire (&flush_lock);
+    cache_wake_flusher ();
+    if (dirty >= dirty_limit)
+    {
+        unsigned pass = flush_passes;
+        while (flush_passes == pass)
+            cond_wait (&flush_done, &flush_lock);
+    }
+    lock_release (&flush_lock);
+}
+
+/*
+ * Waits, with C's shard lock held and C pinned, until C can be held
+ * shared (or exclusively if EXCLUSIVE).
+ */
+static void
+cache_block_wait (struct cache_block *c, bool exclusive)
+{
+    while (c->io_busy || c->writer || (exclusive && c->readers > 0))
+        cond_wait (&c->released, &c->shard->lock);
+}
 
 /*
+ * Releases a block obtained from cache_block_get().
+ */
 void
-cache_flush_to_disk (bool halt)
+cache_block_put (struct cache_block *c)
 {
-   lock_acquire (&cache_lock);
-   struct list_elem *e;
-   for ( e = list_begin (&cache); e != list_end(&cache); e = list_next (e))
-   {
-       struct cache_block* c = list_entry (e, struct cache_block, elem);
-       if (c->dirty)
-	{
-	   block_write (fs_device, c->sector, &c->block);
-	   c->dirty = false;
+    struct cache_shard *s = c->shard;
+    lock_acquire (&s->lock);
+    if (c->writer)
+        c->writer = false;
+    else
+        c->readers--;
+    c->accessed = true;
+    c->open_cnt--;
+    if (c->open_cnt == 0)
+        cond_signal (&s->block_free, &s->lock);
+    else
+        cond_broadcast (&c->released, &s->lock);
+    lock_release (&s->lock);
+}
+
+/*
+ * Unlinks and returns the oldest prefetched block of shard S that
+ * nobody has read and that is not pinned, or NULL.  Such blocks go
+ * before anything the policy would choose, and leave no ghost.
+ */
+static struct cache_block *
+cache_evict_prefetched (struct cache_shard *s)
+{
+    struct list_elem *e;
+    for (e = list_begin (&s->prefetched); e != list_end (&s->prefetched);
+         e = list_next (e))
+    {
+        struct cache_block *c = list_entry (e, struct cache_block,
+                                            prefetch_elem);
+        if (c->open_cnt == 0 && !c->io_busy)
+        {
+            list_remove (&c->prefetch_elem);
+            c->prefetched = false;
+            queue_remove (s, c);
+            return c;
+        }
+    }
+    return NULL;
+}
+
+/*
+ * Helpers for the replacement policies.  The front of every queue
+ * and ghost list is its least recently used end.
+ */
+
+/* Appends C to queue Q of shard S. */
+static void
+queue_push (struct cache_shard *s, struct cache_block *c, int q)
+{
+    list_push_back (&s->queues[q], &c->elem);
+    c->queue = q;
+    s->queue_len[q]++;
+}
+
+/* Unlinks C from its queue. */
+static void
+queue_remove (struct cache_shard *s, struct cache_block *c)
+{
+    list_remove (&c->elem);
+    s->queue_len[c->queue]--;
+}
+
+/* Returns the least recently used block of queue Q that is not
+   pinned, or NULL if there is none.  Metadata blocks with chances
+   left are passed over, at the cost of one chance, unless nothing
+   else can go. */
+static struct cache_block *
+queue_lru (struct cache_shard *s, int q)
+{
+    struct cache_block *meta = NULL;
+    struct list_elem *e;
+    for (e = list_begin (&s->queues[q]); e != list_end (&s->queues[q]);
+         e = list_next (e))
+    {
+        struct cache_block *c = list_entry (e, struct cache_block, elem);
+        if (c->open_cnt > 0 || c->io_busy)
+            continue;
+        if (c->meta_chances == 0)
+            return c;
+        c->meta_chances--;
+        if (meta == NULL)
+            meta = c;
+    }
+    return meta;
+}
+
+/* Returns the ghost entry for SECTOR, or NULL. */
+static struct cache_ghost *
+ghost_find (struct cache_shard *s, block_sector_t sector)
+{
+    struct hash_elem *e;
+    s->ghost_key.sector = sector;
+    e = hash_find (&s->ghost_map, &s->ghost_key.hash_elem);
+    return e != NULL ? hash_entry (e, struct cache_ghost, hash_elem) : NULL;
+}
+
+/* Forgets ghost entry G. */
+static void
+ghost_remove (struct cache_shard *s, struct cache_ghost *g)
+{
+    list_remove (&g->elem);
+    hash_delete (&s->ghost_map, &g->hash_elem);
+    s->ghost_len[g->queue]--;
+    list_push_back (&s->free_ghosts, &g->elem);
+}
+
+/* Forgets the oldest entry of ghost list Q. */
+static void
+ghost_remove_lru (struct cache_shard *s, int q)
+{
+    ghost_remove (s, list_entry (list_front (&s->ghosts[q]),
+                                 struct cache_ghost, elem));
+}
+
+/* Remembers SECTOR in ghost list Q.  If no entry is free, the
+   oldest one of list Q, or of the other list if Q is empty, is
+   recycled. */
+static void
+ghost_add (struct cache_shard *s, int q, block_sector_t sector)
+{
+    struct cache_ghost *g;
+    if (list_empty (&s->free_ghosts))
+        ghost_remove_lru (s, s->ghost_len[q] > 0 ? q : !q);
+    g = list_entry (list_pop_front (&s->free_ghosts), struct cache_ghost, elem);
+    g->sector = sector;
+    g->queue = q;
+    list_push_back (&s->ghosts[q], &g->elem);
+    hash_insert (&s->ghost_map, &g->hash_elem);
+    s->ghost_len[q]++;
+}
+
+/*
+ * Clock: a single queue swept by the hand, which is its front.
+ * Blocks accessed since the last sweep get a second chance and
+ * move behind the hand.  Metadata blocks get CACHE_META_CHANCES
+ * more.
+ */
+static void
+clock_insert (struct cache_shard *s, struct cache_block *c)
+{
+    c->accessed = true;
+    queue_push (s, c, 0);
+}
+
+static void
+clock_touch (struct cache_shard *s UNUSED, struct cache_block *c)
+{
+    c->accessed = true;
+}
+
+static struct cache_block *
+clock_evict (struct cache_shard *s, block_sector_t sector UNUSED)
+{
+    size_t i;
+    for (i = 0; i < (2 + CACHE_META_CHANCES) * s->queue_len[0]; i++)
+    {
+        struct cache_block *c = list_entry (list_pop_front (&s->queues[0]),
+                                            struct cache_block, elem);
+        list_push_back (&s->queues[0], &c->elem);
+        if (c->open_cnt > 0 || c->io_busy)
+            continue;
+        if (c->accessed)
+            c->accessed = false;
+        else if (c->meta_chances > 0)
+            c->meta_chances--;
+        else
+        {
+            queue_remove (s, c);
+            return c;
         }
-	if (halt)
-	{
-	  list_remove (&c->elem);
-	  free (c);
-	}
     }
-   lock_release (&cache_lock);
+    return NULL;
+}
+
+static const struct cache_policy clock_policy =
+  {"clock", clock_insert, clock_touch, clock_evict};
+
+/*
+ * 2Q: new blocks enter the FIFO queues[0] (A1in).  Blocks evicted
+ * from it are remembered in ghosts[0] (A1out), and only a block
+ * referenced again while remembered gets into the LRU queues[1]
+ * (Am).  A long sequential scan thus cycles through A1in only and
+ * leaves the hot blocks in Am alone.
+ */
+static void
+twoq_insert (struct cache_shard *s, struct cache_block *c)
+{
+    struct cache_ghost *g = ghost_find (s, c->sector);
+    if (g != NULL)
+    {
+        ghost_remove (s, g);
+        queue_push (s, c, 1);
+    }
+    else
+        queue_push (s, c, 0);
+}
+
+static void
+twoq_touch (struct cache_shard *s, struct cache_block *c)
+{
+    if (c->queue == 1)
+    {
+        list_remove (&c->elem);
+        list_push_back (&s->queues[1], &c->elem);
+    }
+}
+
+static struct cache_block *
+twoq_evict (struct cache_shard *s, block_sector_t sector UNUSED)
+{
+    size_t kin = s->capacity / 4 > 0 ? s->capacity / 4 : 1;
+    size_t kout = s->capacity / 2 > 0 ? s->capacity / 2 : 1;
+    struct cache_block *c = NULL;
+
+    if (s->queue_len[0] > kin || s->queue_len[1] == 0)
+        c = queue_lru (s, 0);
+    if (c == NULL)
+        c = queue_lru (s, 1);
+    if (c == NULL)
+        c = queue_lru (s, 0);
+    if (c == NULL)
+        return NULL;
+
+    queue_remove (s, c);
+    if (c->queue == 0)
+    {
+        if (s->ghost_len[0] >= kout)
+            ghost_remove_lru (s, 0);
+        ghost_add (s, 0, c->sector);
+    }
+    return c;
+}
+
+static const struct cache_policy twoq_policy =
+  {"2q", twoq_insert, twoq_touch, twoq_evict};
+
+/*
+ * ARC: queues[0] (T1) holds blocks seen once lately, queues[1]
+ * (T2) blocks seen at least twice, and ghosts[0] and ghosts[1]
+ * (B1, B2) remember what was evicted from each.  A miss found in
+ * B1 means T1 is too short and raises its target length; one
+ * found in B2 lowers it.  Victims come from T1 while it is longer
+ * than the target, from T2 otherwise.
+ */
+static void
+arc_insert (struct cache_shard *s, struct cache_block *c)
+{
+    struct cache_ghost *g = ghost_find (s, c->sector);
+    if (g != NULL)
+    {
+        ghost_remove (s, g);
+        queue_push (s, c, 1);
+    }
+    else
+        queue_push (s, c, 0);
+}
+
+static void
+arc_touch (struct cache_shard *s, struct cache_block *c)
+{
+    queue_remove (s, c);
+    queue_push (s, c, 1);
+}
+
+static struct cache_block *
+arc_evict (struct cache_shard *s, block_sector_t sector)
+{
+    struct cache_ghost *g = ghost_find (s, sector);
+    struct cache_block *c;
+    size_t delta;
+    int q;
+
+    /* Adapt the target length of T1. */
+    if (g != NULL && g->queue == 0)
+    {
+        delta = s->ghost_len[1] > s->ghost_len[0]
+                ? s->ghost_len[1] / s->ghost_len[0] : 1;
+        s->target = s->target + delta < s->capacity
+                    ? s->target + delta : s->capacity;
+    }
+    else if (g != NULL)
+    {
+        delta = s->ghost_len[0] > s->ghost_len[1]
+                ? s->ghost_len[0] / s->ghost_len[1] : 1;
+        s->target = s->target > delta ? s->target - delta : 0;
+    }
+
+    q = s->queue_len[0] > 0
+        && (s->queue_len[0] > s->target
+            || (g != NULL && g->queue == 1 && s->queue_len[0] == s->target))
+        ? 0 : 1;
+    c = queue_lru (s, q);
+    if (c == NULL)
+    {
+        q = !q;
+        c = queue_lru (s, q);
+    }
+    if (c == NULL)
+        return NULL;
+
+    queue_remove (s, c);
+    /* Keep T1 and B1 together within the shard size, but never
+       drop G, which arc_insert() is about to look for. */
+    while (s->ghost_len[0] > 0
+           && s->queue_len[0] + s->ghost_len[0] >= s->capacity
+           && (g == NULL || list_front (&s->ghosts[0]) != &g->elem))
+        ghost_remove_lru (s, 0);
+    ghost_add (s, q, c->sector);
+    return c;
+}
+
+static const struct cache_policy arc_policy =
+  {"arc", arc_insert, arc_touch, arc_evict};
+
+
+/* Orders cache blocks by sector number, for qsort(). */
+static int
+cache_block_compare (const void *a_, const void *b_)
+{
+    const struct cache_block *a = *(struct cache_block *const *) a_;
+    const struct cache_block *b = *(struct cache_block *const *) b_;
+    return a->sector < b->sector ? -1 : a->sector > b->sector;
+}
+
+/*
+ * Prepares pinned block C to be written by the flusher.  Returns
+ * true if C is dirty, in which case it is now held shared and
+ * marked clean.  Otherwise C is unpinned.  Blocks held for writing
+ * are left alone unless HALT, because their writers may be
+ * throttled waiting for the flusher.
+ */
+static bool
+cache_flush_hold (struct cache_block *c, bool halt)
+{
+  struct cache_shard *s = c->shard;
+  bool write = false;
+
+  lock_acquire (&s->lock);
+  if (!c->writer || halt)
+    {
+      cache_block_wait (c, false);
+      write = c->dirty;
+    }
+  if (write)
+    {
+      c->readers++;
+      cache_mark_clean (s, c);
+    }
+  else
+    {
+      c->open_cnt--;
+      cond_broadcast (&c->released, &s->lock);
+      if (c->open_cnt == 0)
+        cond_signal (&s->block_free, &s->lock);
+    }
+  lock_release (&s->lock);
+  return write;
 }
-*/
+
+/* Releases a block prepared by cache_flush_hold() once it has been
+   written. */
+static void
+cache_flush_done (struct block_request *r)
+{
+  struct cache_block *c = r->aux;
+  struct cache_shard *s = c->shard;
+
+  lock_acquire (&s->lock);
+  c->readers--;
+  c->open_cnt--;
+  cond_broadcast (&c->released, &s->lock);
+  if (c->open_cnt == 0)
+    cond_signal (&s->block_free, &s->lock);
+  lock_release (&s->lock);
+  sema_up (&flush_pending);
+}
+
+/*
+ *  flush dirty cache block back to disk.  The dirty blocks of all
+ *  shards are pinned and collected first, then queued for writing
+ *  all at once in sector order, so the disk queue merges runs of
+ *  consecutive sectors into single transfers.  A block is held shared while it is written,
+ *  so readers carry on and only writers to that one sector wait.
+ *  Blocks held for writing are skipped, unless HALT, in which case
+ *  everything is written and the cache is emptied after.
+ */
 void cache_flush_to_disk (bool halt)
 {
-  lock_acquire(&cache_lock);
-  struct list_elem *next, *e = list_begin(&cache);
-  while (e != list_end(&cache))
+  size_t cnt = 0, write_cnt = 0, i;
+
+  lock_acquire (&flush_serial);
+  for (i = 0; i < CACHE_SHARDS; i++)
     {
-      next = list_next(e);
-      struct cache_block *c = list_entry(e, struct cache_block, elem);
-      if (c->dirty)
-	{
-	  block_write (fs_device, c->sector, &c->block);
-	  c->dirty = false;
-	}
-      if (halt)
-	{
-	  list_remove(&c->elem);
-	  free(c);
-	}
-      e = next;
+      struct cache_shard *s = &cache_shards[i];
+      struct list_elem *e;
+
+      lock_acquire (&s->lock);
+      for (e = list_begin (&s->dirty); e != list_end (&s->dirty);
+           e = list_next (e))
+        {
+          struct cache_block *c = list_entry (e, struct cache_block,
+                                              dirty_elem);
+          if (c->io_busy || (c->writer && !halt))
+            continue;
+          c->open_cnt++;
+          flush_batch[cnt++] = c;
+        }
+      lock_release (&s->lock);
     }
-  lock_release(&cache_lock);
+  qsort (flush_batch, cnt, sizeof *flush_batch, cache_block_compare);
+
+  for (i = 0; i < cnt; i++)
+    {
+      struct cache_block *c = flush_batch[i];
+      if (!cache_flush_hold (c, halt))
+        continue;
+      cache_block_submit (c, true, cache_flush_done);
+      write_cnt++;
+    }
+  while (write_cnt-- > 0)
+    sema_down (&flush_pending);
+
+  if (halt)
+    for (i = 0; i < CACHE_SHARDS; i++)
+      {
+        struct cache_shard *s = &cache_shards[i];
+        lock_acquire (&s->lock);
+        cache_shard_reset (s);
+        lock_release (&s->lock);
+      }
+  lock_release (&flush_serial);
+}
+
+/*
+ * Prints cache statistics.
+ */
+void
+cache_print_stats (void)
+{
+  unsigned long long hits = 0, misses = 0, evictions = 0;
+  unsigned long long read_aheads = 0, read_ahead_hits = 0;
+  int i;
+  for (i = 0; i < CACHE_SHARDS; i++)
+    {
+      hits += cache_shards[i].hits;
+      misses += cache_shards[i].misses;
+      evictions += cache_shards[i].evictions;
+      read_aheads += cache_shards[i].read_aheads;
+      read_ahead_hits += cache_shards[i].read_ahead_hits;
+    }
+  printf ("Cache (%s): %llu hits, %llu misses, %llu evictions\n",
+          cache_policy->name, hits, misses, evictions);
+  printf ("Cache: %llu sectors read ahead, %llu of them used\n",
+          read_aheads, read_ahead_hits);
 }
 
 /*
- * Periodically flush dirty cache back to disk
+ * Flushes dirty cache back to disk whenever asked to, by the timer
+ * or by writers that find too much of the cache dirty.  Throttled
+ * writers are released after every pass.
  */
 void
 thread_func_flush_back (void *aux UNUSED)
 {
+   lock_acquire (&flush_lock);
    while (true)
    {
-	timer_sleep (FLUSH_BACK_INTERVAL);
+        while (!flush_requested)
+            cond_wait (&flush_wanted, &flush_lock);
+        flush_requested = false;
+        lock_release (&flush_lock);
+
         cache_flush_to_disk (false);
+
+        lock_acquire (&flush_lock);
+        flush_passes++;
+        cond_broadcast (&flush_done, &flush_lock);
    }
 }
 
-
 /*
- * Read-ahead implementation.  
+ * Periodically wakes the flusher, so nothing stays dirty much
+ * longer than FLUSH_BACK_INTERVAL.  Writers wake it earlier once
+ * the background threshold is crossed.
  */
 void
-read_ahead (block_sector_t sector)
+thread_func_flush_timer (void *aux UNUSED)
 {
-   block_sector_t *arg = malloc (sizeof (block_sector_t));
-   if (arg)
+   while (true)
    {
-	*arg = sector + 1;
-        thread_create ("cache_read_ahead", 0, thread_func_read_ahead, arg);
+	timer_sleep (FLUSH_BACK_INTERVAL);
+        lock_acquire (&flush_lock);
+        cache_wake_flusher ();
+        lock_release (&flush_lock);
    }
 }
 
+
+/*
+ * Asks the read-ahead thread to bring SECTOR into the cache.  Never
+ * blocks; the request is dropped if the queue is full.
+ */
 void
-thread_func_read_ahead (void *aux)
+cache_read_ahead (block_sector_t sector)
 {
-    block_sector_t sector = * (block_sector_t *)aux;
-    lock_acquire (&cache_lock);
-    struct cache_block *c = block_in_cache (sector);
-    if (!c)
-    {
-        cache_block_get (sector, false);
-    }
-    lock_release (&cache_lock);
-    free (aux);
+   lock_acquire (&read_ahead_lock);
+   if (read_ahead_cnt < READ_AHEAD_QUEUE)
+   {
+        read_ahead_queue[(read_ahead_head + read_ahead_cnt++)
+                         % READ_AHEAD_QUEUE] = sector;
+        cond_signal (&read_ahead_ready, &read_ahead_lock);
+   }
+   lock_release (&read_ahead_lock);
 }
 
+/*
+ * Serves read-ahead requests one at a time, in the order they
+ * were made.
+ */
+void
+thread_func_read_ahead (void *aux UNUSED)
+{
+   while (true)
+   {
+        block_sector_t sector;
 
+        lock_acquire (&read_ahead_lock);
+        while (read_ahead_cnt == 0)
+            cond_wait (&read_ahead_ready, &read_ahead_lock);
+        sector = read_ahead_queue[read_ahead_head];
+        read_ahead_head = (read_ahead_head + 1) % READ_AHEAD_QUEUE;
+        read_ahead_cnt--;
+        read_ahead_current = sector;
+        read_ahead_busy = true;
+        lock_release (&read_ahead_lock);
 
+        /* Once this returns the block is in the cache, marked
+           io_busy until its read completes, so cache_zero() will
+           find it and wait. */
+        cache_block_fetch (sector, CACHE_PREFETCH);
 
-
+        lock_acquire (&read_ahead_lock);
+        read_ahead_busy = false;
+        cond_broadcast (&read_ahead_idle, &read_ahead_lock);
+        lock_release (&read_ahead_lock);
+   }
+}
@@ -4,31 +4,139 @@
 #include "devices/block.h"
 #include "devices/timer.h"
 #include "threads/synch.h"
+#include <hash.h>
 #include <list.h>
 
-#define CACHE_AMOUNT 64
+#define CACHE_AMOUNT 64        /* Default number of cached sectors. */
+#define CACHE_SHARDS 8
 #define FLUSH_BACK_INTERVAL 5*TIMER_FREQ
-#define MAX_CACHE_SIZE 64
+#define CACHE_DIRTY_BACKGROUND 10 /* Default % dirty that wakes the flusher. */
+#define CACHE_DIRTY_LIMIT 40   /* Default % dirty that throttles writers. */
+#define READ_AHEAD_QUEUE 64    /* Pending read-ahead requests. */
+#define READ_AHEAD_MAX 32      /* Largest read-ahead window, in sectors. */
+#define CACHE_META_CHANCES 2   /* Extra evictions a metadata block survives. */
+
+/* Flags for cache_block_open(). */
+#define CACHE_WRITE 0x1        /* Hold exclusively and mark dirty. */
+#define CACHE_META 0x2         /* Inode or indirect block; keep longer. */
+#define CACHE_NOREAD 0x4       /* Whole sector is overwritten; don't read it. */
+
+struct cache_shard;
+
+/*
+ * A cached sector.  A block is held either shared by any number
+ * of readers or exclusively by one writer; open_cnt counts the
+ * holders plus everyone waiting for it, and a block with a
+ * nonzero open_cnt is never evicted.  While io_busy is set the
+ * contents are being moved to or from disk and nobody may take
+ * the block.  All of these fields are protected by the lock of
+ * the shard the block belongs to.
+ *
+ * A block brought in by read-ahead is PREFETCHED until someone
+ * actually reads it, and such blocks are evicted before any other.
+ * A metadata block gets CACHE_META_CHANCES on every use, and the
+ * policies pass it over while it has chances left.
+ *
+ * The metadata of all blocks and their sector buffers live in two
+ * separate arrays allocated once at boot, so BLOCK points into the
+ * sector-aligned data array and the metadata stays compact.
+ */
 struct cache_block
 {
     block_sector_t sector;
     bool dirty;
     bool accessed;
     int open_cnt;
+    int queue;                    /* Policy queue holding the block. */
+    int readers;                  /* Number of shared holders. */
+    bool writer;                  /* Held exclusively? */
+    bool io_busy;                 /* Disk transfer in progress? */
+    bool prefetched;              /* Read ahead and not used yet? */
+    int meta_chances;             /* Evictions left to survive. */
+    struct condition released;    /* Signaled on release and I/O done. */
+    struct cache_shard *shard;    /* Shard owning this block. */
+    struct list_elem elem;
+    struct hash_elem hash_elem;   /* Element in shard's map, keyed by sector. */
+    struct list_elem prefetch_elem; /* Element in shard's prefetched list. */
+    struct list_elem dirty_elem;  /* Element in shard's dirty list. */
+    struct block_request io;      /* Asynchronous flush or read-ahead. */
+    uint8_t *block;               /* BLOCK_SECTOR_SIZE bytes of data. */
+};
+
+/*
+ * A sector that was recently evicted.  2Q and ARC remember these
+ * to tell blocks that get reused from one-time accesses.
+ */
+struct cache_ghost
+{
+    block_sector_t sector;
+    int queue;                    /* Ghost list holding the entry. */
     struct list_elem elem;
-    uint8_t block[BLOCK_SECTOR_SIZE];
+    struct hash_elem hash_elem;
+};
+
+/*
+ * The cache is split into CACHE_SHARDS independent shards, chosen
+ * by sector number.  Each shard has its own lock, sector index and
+ * replacement state, so lookups of sectors in different shards
+ * never contend, and disk I/O is always done with the shard lock
+ * released.
+ */
+struct cache_shard
+{
+    struct lock lock;
+    struct list queues[2];        /* Resident blocks, ordered by policy. */
+    size_t queue_len[2];
+    struct list ghosts[2];        /* Evicted sectors, ordered by policy. */
+    size_t ghost_len[2];
+    size_t target;                /* ARC: target length of queues[0]. */
+    struct list free_blocks;      /* Blocks not holding any sector yet. */
+    struct list free_ghosts;
+    struct list prefetched;       /* Unused read-ahead blocks, oldest first. */
+    struct list dirty;            /* Blocks with unwritten changes. */
+    size_t dirty_cnt;
+    struct hash map;              /* Sector -> cache_block index. */
+    struct hash ghost_map;        /* Sector -> cache_ghost index. */
+    size_t capacity;              /* Number of blocks in the shard. */
+    struct condition block_free;  /* Signaled when a block is unpinned. */
+    struct cache_block key;       /* Lookup keys, used under LOCK. */
+    struct cache_ghost ghost_key;
+    unsigned long long hits, misses, evictions;
+    unsigned long long read_aheads, read_ahead_hits;
+};
+
+/*
+ * A replacement policy.  Every hook is called with the shard lock
+ * held.  INSERT links a block that was just given a new sector,
+ * TOUCH records a hit, and EVICT unlinks and returns an unpinned
+ * block to make room for SECTOR, or returns NULL if every block is
+ * pinned.
+ */
+struct cache_policy
+{
+    const char *name;
+    void (*insert) (struct cache_shard *, struct cache_block *);
+    void (*touch) (struct cache_shard *, struct cache_block *);
+    struct cache_block *(*evict) (struct cache_shard *, block_sector_t sector);
 };
 
-struct lock cache_lock;
-struct list cache;
-uint32_t cache_size;
+struct cache_shard cache_shards[CACHE_SHARDS];
 
 
+void cache_configure (size_t block_cnt);
+bool cache_set_policy (const char *name);
+void cache_configure_dirty (int background, int limit);
 void cache_init (void);
+void cache_print_stats (void);
 
+struct cache_shard *cache_shard_for (block_sector_t sector);
+struct cache_block* block_in_cache (block_sector_t sector);
 struct cache_block* cache_block_get(block_sector_t sector, bool dirty);
+struct cache_block *cache_block_open (block_sector_t sector, unsigned flags);
+void cache_block_put (struct cache_block *c);
 void cache_flush_to_disk (bool halt);
-void read_ahead (block_sector_t sector);
+void cache_read_ahead (block_sector_t sector);
+void cache_zero (block_sector_t sector, size_t cnt);
 
 
 
@@ -0,0 +1,236 @@
+#include "filesys/dcache.h"
+#include <debug.h>
+#include <hash.h>
+#include <list.h>
+#include <stdio.h>
+#include <string.h>
+#include "filesys/directory.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
+
+/*
+ * The dentry cache remembers the result of recent directory
+ * lookups, so resolving a path doesn't search every directory on
+ * the way.  Each entry maps a name in the directory whose inode is
+ * in PARENT to the sector of the inode it names, or to
+ * DCACHE_NEGATIVE if there is no such name.
+ *
+ * Callers keep the entries right: dir_lookup() fills them in, and
+ * dir_add() and dir_remove() update them, all while holding the
+ * lock of the directory concerned.  Entries are recycled in least
+ * recently used order from a pool allocated at boot.
+ */
+struct dentry
+  {
+    block_sector_t parent;              /* Directory inode sector. */
+    block_sector_t sector;              /* Named inode or DCACHE_NEGATIVE. */
+    char name[NAME_MAX + 1];
+    struct hash_elem hash_elem;         /* Element in dentries. */
+    struct list_elem lru_elem;          /* Element in lru or free list. */
+  };
+
+/* Number of names to cache, set by "-dcache=N". */
+static size_t dcache_entry_cnt = DCACHE_AMOUNT;
+
+static struct lock dcache_lock;         /* Protects everything below. */
+static struct hash dentries;            /* (Parent, name) -> dentry. */
+static struct list lru;                 /* Most recently used first. */
+static struct list free_dentries;       /* Entries not in use. */
+static struct dentry key;               /* Lookup key. */
+static unsigned long long hits, negative_hits, misses, invalidations;
+
+static unsigned dentry_hash (const struct hash_elem *, void *);
+static bool dentry_less (const struct hash_elem *, const struct hash_elem *,
+                         void *);
+static struct dentry *dentry_find (block_sector_t parent, const char *name);
+static void dentry_free (struct dentry *);
+
+/* Sets the number of names to cache to ENTRY_CNT, which may be 0
+   to turn the cache off.  Must be called before dcache_init(). */
+void
+dcache_configure (size_t entry_cnt)
+{
+  dcache_entry_cnt = entry_cnt;
+}
+
+/* Initializes the dentry cache. */
+void
+dcache_init (void)
+{
+  struct dentry *pool;
+  size_t i;
+
+  lock_init (&dcache_lock);
+  hash_init (&dentries, dentry_hash, dentry_less, NULL);
+  list_init (&lru);
+  list_init (&free_dentries);
+  if (dcache_entry_cnt == 0)
+    return;
+
+  pool = calloc (dcache_entry_cnt, sizeof *pool);
+  if (pool == NULL)
+    PANIC ("Not enough memory for %zu-entry dentry cache", dcache_entry_cnt);
+  for (i = 0; i < dcache_entry_cnt; i++)
+    list_push_back (&free_dentries, &pool[i].lru_elem);
+}
+
+/* Prints dentry cache statistics. */
+void
+dcache_print_stats (void)
+{
+  unsigned long long lookups = hits + misses;
+
+  printf ("Dcache: %llu hits (%llu negative), %llu misses, "
+          "%llu invalidations, %llu%% hit rate\n",
+          hits, negative_hits, misses, invalidations,
+          lookups > 0 ? hits * 100 / lookups : 0);
+}
+
+/* Looks up NAME in the directory whose inode is in PARENT.
+   Returns true if the answer is cached and sets *SECTORP to the
+   sector of the named inode, or to DCACHE_NEGATIVE if there is
+   no such name.  Returns false if the directory must be
+   searched. */
+bool
+dcache_lookup (block_sector_t parent, const char *name,
+               block_sector_t *sectorp)
+{
+  struct dentry *d;
+
+  lock_acquire (&dcache_lock);
+  d = dentry_find (parent, name);
+  if (d != NULL)
+    {
+      list_remove (&d->lru_elem);
+      list_push_front (&lru, &d->lru_elem);
+      *sectorp = d->sector;
+      hits++;
+      if (d->sector == DCACHE_NEGATIVE)
+        negative_hits++;
+    }
+  else
+    misses++;
+  lock_release (&dcache_lock);
+  return d != NULL;
+}
+
+/* Records that NAME in the directory whose inode is in PARENT
+   names the inode in SECTOR, or nothing if SECTOR is
+   DCACHE_NEGATIVE, replacing the least recently used entry if
+   the cache is full. */
+void
+dcache_insert (block_sector_t parent, const char *name, block_sector_t sector)
+{
+  struct dentry *d;
+
+  if (strlen (name) > NAME_MAX)
+    return;
+
+  lock_acquire (&dcache_lock);
+  d = dentry_find (parent, name);
+  if (d != NULL)
+    list_remove (&d->lru_elem);
+  else
+    {
+      if (!list_empty (&free_dentries))
+        d = list_entry (list_pop_front (&free_dentries),
+                        struct dentry, lru_elem);
+      else if (!list_empty (&lru))
+        {
+          d = list_entry (list_pop_back (&lru), struct dentry, lru_elem);
+          hash_delete (&dentries, &d->hash_elem);
+        }
+      else
+        {
+          /* The cache is turned off. */
+          lock_release (&dcache_lock);
+          return;
+        }
+      d->parent = parent;
+      strlcpy (d->name, name, sizeof d->name);
+      hash_insert (&dentries, &d->hash_elem);
+    }
+  d->sector = sector;
+  list_push_front (&lru, &d->lru_elem);
+  lock_release (&dcache_lock);
+}
+
+/* Forgets what is known about NAME in the directory whose inode
+   is in PARENT. */
+void
+dcache_invalidate (block_sector_t parent, const char *name)
+{
+  struct dentry *d;
+
+  lock_acquire (&dcache_lock);
+  d = dentry_find (parent, name);
+  if (d != NULL)
+    dentry_free (d);
+  lock_release (&dcache_lock);
+}
+
+/* Forgets every name in the directory whose inode is in PARENT,
+   which is being deleted, so that nothing stale is found if its
+   sector becomes another directory. */
+void
+dcache_invalidate_dir (block_sector_t parent)
+{
+  struct list_elem *e;
+
+  lock_acquire (&dcache_lock);
+  for (e = list_begin (&lru); e != list_end (&lru); )
+    {
+      struct dentry *d = list_entry (e, struct dentry, lru_elem);
+      e = list_next (e);
+      if (d->parent == parent)
+        dentry_free (d);
+    }
+  lock_release (&dcache_lock);
+}
+
+/* Returns the entry for NAME in PARENT, or a null pointer if there
+   is none.  The cache lock must be held. */
+static struct dentry *
+dentry_find (block_sector_t parent, const char *name)
+{
+  struct hash_elem *e;
+
+  if (strlen (name) > NAME_MAX)
+    return NULL;
+  key.parent = parent;
+  strlcpy (key.name, name, sizeof key.name);
+  e = hash_find (&dentries, &key.hash_elem);
+  return e != NULL ? hash_entry (e, struct dentry, hash_elem) : NULL;
+}
+
+/* Moves D from the cache to the free list.  The cache lock must
+   be held. */
+static void
+dentry_free (struct dentry *d)
+{
+  hash_delete (&dentries, &d->hash_elem);
+  list_remove (&d->lru_elem);
+  list_push_front (&free_dentries, &d->lru_elem);
+  invalidations++;
+}
+
+/* Returns a hash of the parent and name of a dentry. */
+static unsigned
+dentry_hash (const struct hash_elem *e, void *aux UNUSED)
+{
+  const struct dentry *d = hash_entry (e, struct dentry, hash_elem);
+  return hash_string (d->name) ^ hash_int (d->parent);
+}
+
+/* Returns true if dentry A precedes dentry B. */
+static bool
+dentry_less (const struct hash_elem *a_, const struct hash_elem *b_,
+             void *aux UNUSED)
+{
+  const struct dentry *a = hash_entry (a_, struct dentry, hash_elem);
+  const struct dentry *b = hash_entry (b_, struct dentry, hash_elem);
+
+  if (a->parent != b->parent)
+    return a->parent < b->parent;
+  return strcmp (a->name, b->name) < 0;
+}
@@ -0,0 +1,25 @@
+#ifndef FILESYS_DCACHE_H
+#define FILESYS_DCACHE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "devices/block.h"
+
+#define DCACHE_AMOUNT 128       /* Default number of cached names. */
+
+/* Sector recorded for a name known not to exist.  Sector 0 holds
+   the free map inode, which no directory ever names. */
+#define DCACHE_NEGATIVE 0
+
+void dcache_configure (size_t entry_cnt);
+void dcache_init (void);
+void dcache_print_stats (void);
+
+bool dcache_lookup (block_sector_t parent, const char *name,
+                    block_sector_t *sectorp);
+void dcache_insert (block_sector_t parent, const char *name,
+                    block_sector_t sector);
+void dcache_invalidate (block_sector_t parent, const char *name);
+void dcache_invalidate_dir (block_sector_t parent);
+
+#endif /* filesys/dcache.h */
@@ -1,7 +1,10 @@
 #include "filesys/directory.h"
 #include <stdio.h>
 #include <string.h>
+#include <hash.h>
 #include <list.h>
+#include <round.h>
+#include "filesys/dcache.h"
 #include "filesys/filesys.h"
 #include "filesys/inode.h"
 #include "threads/malloc.h"
@@ -22,12 +25,124 @@ struct dir_entry
     bool in_use;                        /* In use or free? */
   };
 
+/*
+ * Indexed directories.
+ *
+ * A linear directory is just an array of dir_entry, searched from
+ * the front.  An indexed directory is made of BLOCK_SECTOR_SIZE
+ * blocks forming a B+tree keyed on hash_string() of the names, in
+ * the style of the ext3 htree: block 0 is the root index node,
+ * leaves hold up to DIR_LEAF_ENTRIES entries each, and when the
+ * tree gets deeper there are index nodes in between.  Every index
+ * entry covers the hashes from its own HASH up to the next entry's,
+ * and names with the same hash are always kept in the same leaf.
+ *
+ * The root starts with DIR_ROOT_MAGIC where a linear directory has
+ * the inode sector of its first entry, which no real disk is large
+ * enough to reach, so the two formats are told apart by reading it.
+ * Leaves are never merged; a removed entry leaves a free slot that
+ * a later name with a nearby hash reuses.
+ */
+#define DIR_ROOT_MAGIC 0x58444944       /* "DIDX". */
+#define DIR_NODE_MAGIC 0x45444f4e       /* "NODE". */
+#define DIR_LEAF_MAGIC 0x4641454c       /* "LEAF". */
+#define DIR_NODE_INDEX 62               /* Index entries per node. */
+#define DIR_LEAF_ENTRIES 25             /* Entries per leaf. */
+#define DIR_MAX_DEPTH 4                 /* Most index nodes on a path. */
+
+/* An index entry: hashes from HASH up live under BLOCK. */
+struct dir_index
+  {
+    uint32_t hash;
+    uint32_t block;                     /* Block number in the file. */
+  };
+
+/* The root or an inner node of an indexed directory. */
+struct dir_node
+  {
+    uint32_t magic;                     /* DIR_ROOT_MAGIC or DIR_NODE_MAGIC. */
+    uint16_t levels;                    /* Root: node levels below it. */
+    uint16_t index_cnt;                 /* Entries used in INDEX. */
+    uint32_t entry_cnt;                 /* Root: names in the directory. */
+    uint32_t unused;
+    struct dir_index index[DIR_NODE_INDEX];
+  };
+
+/* A leaf of an indexed directory. */
+struct dir_leaf
+  {
+    uint32_t magic;                     /* DIR_LEAF_MAGIC. */
+    uint32_t unused;
+    struct dir_entry entries[DIR_LEAF_ENTRIES];
+  };
+
+/* Any block of an indexed directory. */
+union dir_block
+  {
+    struct dir_node node;
+    struct dir_leaf leaf;
+    uint8_t raw[BLOCK_SECTOR_SIZE];
+  };
+
+/* The index nodes visited on the way down to a leaf. */
+struct dir_path
+  {
+    int depth;                          /* Number of nodes. */
+    uint32_t blocks[DIR_MAX_DEPTH];     /* Block of each node, root first. */
+    size_t slots[DIR_MAX_DEPTH];        /* Index entry followed in each. */
+  };
+
+/* Working space for adding to an indexed directory, too large for
+   the kernel stack. */
+struct dir_scratch
+  {
+    union dir_block block;
+    struct dir_path path;
+    struct dir_index index[DIR_MAX_DEPTH][DIR_NODE_INDEX + 1];
+    struct dir_entry entries[DIR_LEAF_ENTRIES + 1];
+    uint32_t hashes[DIR_LEAF_ENTRIES + 1];
+  };
+
+/* Whether directories created from now on are indexed. */
+static bool dir_indexed = true;
+
+static bool index_init (struct inode *);
+
+/* Selects the format of directories created from now on by NAME,
+   "indexed" or "linear".  Existing directories keep theirs.
+   Returns false if NAME is unknown. */
+bool
+dir_set_format (const char *name)
+{
+  if (!strcmp (name, "indexed"))
+    dir_indexed = true;
+  else if (!strcmp (name, "linear"))
+    dir_indexed = false;
+  else
+    return false;
+  return true;
+}
+
 /* Creates a directory with space for ENTRY_CNT entries in the
-   given SECTOR.  Returns true if successful, false on failure. */
+   given SECTOR, in the format chosen by dir_set_format().  An
+   indexed directory starts out as an empty root and grows as
+   names are added, so ENTRY_CNT only matters to a linear one.
+   Returns true if successful, false on failure. */
 bool
 dir_create (block_sector_t sector, size_t entry_cnt)
 {
-  return inode_create (sector, entry_cnt * sizeof (struct dir_entry), true);
+  struct inode *inode;
+  bool success;
+
+  if (!dir_indexed)
+    return inode_create (sector, entry_cnt * sizeof (struct dir_entry), true);
+
+  if (!inode_create (sector, 0, true))
+    return false;
+  inode = inode_open (sector);
+  success = inode != NULL && index_init (inode);
+  inode_close (inode);
+  return success;
 }
 
 /* Opens and returns the directory for the given INODE, of which
@@ -77,6 +192,26 @@ dir_close (struct dir *dir)
     }
 }
 
+/* Sets the position from which dir_readdir() continues in DIR to
+   POS, which must have been returned by dir_tell() for a directory
+   with the same inode. */
+void
+dir_seek (struct dir *dir, off_t pos)
+{
+  ASSERT (dir != NULL);
+  ASSERT (pos >= 0);
+  dir->pos = pos;
+}
+
+/* Returns the position from which dir_readdir() continues in
+   DIR. */
+off_t
+dir_tell (struct dir *dir)
+{
+  ASSERT (dir != NULL);
+  return dir->pos;
+}
+
 /* Returns the inode encapsulated by DIR. */
 struct inode *
 dir_get_inode (struct dir *dir) 
@@ -84,6 +219,413 @@ dir_get_inode (struct dir *dir)
   return dir->inode;
 }
 
+/* Reads block BLOCK of directory INODE into BUF.  Returns true
+   if successful, false if the directory is too short. */
+static bool
+read_block (struct inode *inode, uint32_t block, void *buf)
+{
+  return inode_read_at (inode, buf, BLOCK_SECTOR_SIZE,
+                        (off_t) block * BLOCK_SECTOR_SIZE) == BLOCK_SECTOR_SIZE;
+}
+
+/* Writes BUF to block BLOCK of directory INODE, extending the
+   directory if BLOCK is just past its end.  Returns true if
+   successful, false on failure. */
+static bool
+write_block (struct inode *inode, uint32_t block, const void *buf)
+{
+  return inode_write_at (inode, buf, BLOCK_SECTOR_SIZE,
+                         (off_t) block * BLOCK_SECTOR_SIZE) == BLOCK_SECTOR_SIZE;
+}
+
+/* Returns the number of the block that would be appended to
+   indexed directory INODE. */
+static uint32_t
+next_block (struct inode *inode)
+{
+  return DIV_ROUND_UP (inode_length (inode), BLOCK_SECTOR_SIZE);
+}
+
+/* Returns the byte offset of entry IDX of leaf block LEAF. */
+static off_t
+leaf_ofs (uint32_t leaf, size_t idx)
+{
+  return ((off_t) leaf * BLOCK_SECTOR_SIZE + offsetof (struct dir_leaf, entries)
+          + idx * sizeof (struct dir_entry));
+}
+
+/* Returns true if directory INODE is indexed, false if it is
+   linear. */
+static bool
+is_indexed (struct inode *inode)
+{
+  uint32_t magic;
+
+  return (inode_read_at (inode, &magic, sizeof magic, 0) == sizeof magic
+          && magic == DIR_ROOT_MAGIC);
+}
+
+/* Makes B an index node with MAGIC holding the CNT entries in
+   INDEX. */
+static void
+node_fill (union dir_block *b, uint32_t magic,
+           const struct dir_index *index, size_t cnt)
+{
+  memset (b, 0, sizeof *b);
+  b->node.magic = magic;
+  b->node.index_cnt = cnt;
+  memcpy (b->node.index, index, cnt * sizeof *index);
+}
+
+/* Makes B a leaf holding the CNT entries in ENTRIES. */
+static void
+leaf_fill (union dir_block *b, const struct dir_entry *entries, size_t cnt)
+{
+  memset (b, 0, sizeof *b);
+  b->leaf.magic = DIR_LEAF_MAGIC;
+  memcpy (b->leaf.entries, entries, cnt * sizeof *entries);
+}
+
+/* Turns empty directory INODE into an indexed directory whose
+   root points to a single empty leaf.  Returns true if
+   successful, false on failure. */
+static bool
+index_init (struct inode *inode)
+{
+  union dir_block *b = malloc (sizeof *b);
+  struct dir_index first = {0, 1};
+  bool success;
+
+  if (b == NULL)
+    return false;
+  leaf_fill (b, NULL, 0);
+  success = write_block (inode, 1, b);
+  if (success)
+    {
+      node_fill (b, DIR_ROOT_MAGIC, &first, 1);
+      success = write_block (inode, 0, b);
+    }
+  free (b);
+  return success;
+}
+
+/* Returns the slot of the index entry in NODE that covers
+   HASH. */
+static size_t
+index_slot (const struct dir_node *node, uint32_t hash)
+{
+  size_t lo = 0, hi = node->index_cnt;
+
+  while (hi - lo > 1)
+    {
+      size_t mid = lo + (hi - lo) / 2;
+      if (node->index[mid].hash <= hash)
+        lo = mid;
+      else
+        hi = mid;
+    }
+  return lo;
+}
+
+/* Walks the index of directory INODE down to the leaf that
+   covers HASH, recording the nodes passed in PATH, and reads the
+   leaf into B.  Returns the leaf's block number, or 0 on failure
+   (block 0 is always the root). */
+static uint32_t
+index_descend (struct inode *inode, uint32_t hash, union dir_block *b,
+               struct dir_path *path)
+{
+  uint32_t block = 0;
+  int levels = 0;
+
+  path->depth = 0;
+  do
+    {
+      size_t slot;
+
+      if (path->depth >= DIR_MAX_DEPTH || !read_block (inode, block, b)
+          || b->node.index_cnt == 0)
+        return 0;
+      if (path->depth == 0)
+        levels = b->node.levels;
+      slot = index_slot (&b->node, hash);
+      path->blocks[path->depth] = block;
+      path->slots[path->depth] = slot;
+      path->depth++;
+      block = b->node.index[slot].block;
+    }
+  while (path->depth <= levels);
+
+  if (!read_block (inode, block, b) || b->leaf.magic != DIR_LEAF_MAGIC)
+    return 0;
+  return block;
+}
+
+/* Searches indexed directory INODE for NAME, like lookup(). */
+static bool
+index_lookup (struct inode *inode, const char *name,
+              struct dir_entry *ep, off_t *ofsp)
+{
+  union dir_block *b = malloc (sizeof *b);
+  struct dir_path path;
+  uint32_t leaf;
+  bool found = false;
+  size_t i;
+
+  if (b == NULL)
+    return false;
+  leaf = index_descend (inode, hash_string (name), b, &path);
+  if (leaf != 0)
+    for (i = 0; i < DIR_LEAF_ENTRIES; i++)
+      {
+        struct dir_entry *e = &b->leaf.entries[i];
+        if (e->in_use && !strcmp (name, e->name))
+          {
+            if (ep != NULL)
+              *ep = *e;
+            if (ofsp != NULL)
+              *ofsp = leaf_ofs (leaf, i);
+            found = true;
+            break;
+          }
+      }
+  free (b);
+  return found;
+}
+
+/* Adds DELTA to the number of names recorded in the root of
+   indexed directory INODE.  Returns true if successful, false
+   on failure. */
+static bool
+index_count (struct inode *inode, int delta)
+{
+  off_t ofs = offsetof (struct dir_node, entry_cnt);
+  uint32_t cnt;
+
+  if (inode_read_at (inode, &cnt, sizeof cnt, ofs) != sizeof cnt)
+    return false;
+  cnt += delta;
+  return inode_write_at (inode, &cnt, sizeof cnt, ofs) == sizeof cnt;
+}
+
+/* Moves the CNT entries in S->index[0], which no longer fit in
+   the root of INODE, into two new nodes and makes the root point
+   to those, one level further up.  Returns true if successful,
+   false on failure, in which case the root is unchanged. */
+static bool
+root_split (struct inode *inode, struct dir_scratch *s, size_t cnt)
+{
+  struct dir_node *root = &s->block.node;
+  uint32_t levels = root->levels;
+  uint32_t entry_cnt = root->entry_cnt;
+  uint32_t left = next_block (inode);
+  size_t half = cnt / 2;
+  struct dir_index index[2];
+
+  if (levels + 1 >= DIR_MAX_DEPTH)
+    return false;
+
+  node_fill (&s->block, DIR_NODE_MAGIC, s->index[0], half);
+  if (!write_block (inode, left, &s->block))
+    return false;
+  node_fill (&s->block, DIR_NODE_MAGIC, s->index[0] + half, cnt - half);
+  if (!write_block (inode, left + 1, &s->block))
+    return false;
+
+  index[0].hash = 0;
+  index[0].block = left;
+  index[1].hash = s->index[0][half].hash;
+  index[1].block = left + 1;
+  node_fill (&s->block, DIR_ROOT_MAGIC, index, 2);
+  root->levels = levels + 1;
+  root->entry_cnt = entry_cnt;
+  return write_block (inode, 0, &s->block);
+}
+
+/* Inserts an index entry for HASH pointing to BLOCK into the node
+   at LEVEL of S->path, just after the entry that was followed
+   down, splitting nodes further up the path as needed.  Returns
+   true if successful.  On failure the nodes on the path are
+   unchanged, although new blocks may have been appended. */
+static bool
+index_insert (struct inode *inode, struct dir_scratch *s, int level,
+              uint32_t hash, uint32_t block)
+{
+  struct dir_index *index = s->index[level];
+  uint32_t node = s->path.blocks[level];
+  size_t slot = s->path.slots[level] + 1;
+  size_t cnt, half;
+  uint32_t right;
+
+  if (!read_block (inode, node, &s->block))
+    return false;
+  cnt = s->block.node.index_cnt;
+  memcpy (index, s->block.node.index, slot * sizeof *index);
+  index[slot].hash = hash;
+  index[slot].block = block;
+  memcpy (index + slot + 1, s->block.node.index + slot,
+          (cnt - slot) * sizeof *index);
+  cnt++;
+
+  if (cnt <= DIR_NODE_INDEX)
+    {
+      s->block.node.index_cnt = cnt;
+      memcpy (s->block.node.index, index, cnt * sizeof *index);
+      return write_block (inode, node, &s->block);
+    }
+  if (level == 0)
+    return root_split (inode, s, cnt);
+
+  /* Link the new right half in before trimming the node, so that
+     a failure further up leaves every entry reachable. */
+  half = cnt / 2;
+  right = next_block (inode);
+  node_fill (&s->block, DIR_NODE_MAGIC, index + half, cnt - half);
+  if (!write_block (inode, right, &s->block)
+      || !index_insert (inode, s, level - 1, index[half].hash, right))
+    return false;
+  node_fill (&s->block, DIR_NODE_MAGIC, index, half);
+  return write_block (inode, node, &s->block);
+}
+
+/* Returns the position nearest the middle of the CNT sorted
+   HASHES at which they can be split without separating equal
+   hashes, or 0 if they are all equal. */
+static size_t
+split_point (const uint32_t *hashes, size_t cnt)
+{
+  size_t d;
+
+  for (d = 0; d <= cnt / 2; d++)
+    {
+      size_t lo = cnt / 2 - d, hi = cnt / 2 + d;
+      if (lo > 0 && hashes[lo - 1] != hashes[lo])
+        return lo;
+      if (hi < cnt && hashes[hi - 1] != hashes[hi])
+        return hi;
+    }
+  return 0;
+}
+
+/* Splits full leaf LEAF of INODE, which S->block holds and
+   S->path leads to, in two by hash, and adds NEW to the half it
+   belongs in.  Returns true if successful, false on failure, in
+   which case LEAF is unchanged. */
+static bool
+leaf_split (struct inode *inode, struct dir_scratch *s, uint32_t leaf,
+            const struct dir_entry *new)
+{
+  uint32_t right = next_block (inode);
+  size_t cnt, mid;
+
+  /* Sort the entries and NEW by hash. */
+  for (cnt = 0; cnt <= DIR_LEAF_ENTRIES; cnt++)
+    {
+      const struct dir_entry *e = (cnt < DIR_LEAF_ENTRIES
+                                   ? &s->block.leaf.entries[cnt] : new);
+      uint32_t hash = hash_string (e->name);
+      size_t i;
+
+      for (i = cnt; i > 0 && s->hashes[i - 1] > hash; i--)
+        {
+          s->hashes[i] = s->hashes[i - 1];
+          s->entries[i] = s->entries[i - 1];
+        }
+      s->hashes[i] = hash;
+      s->entries[i] = *e;
+    }
+
+  mid = split_point (s->hashes, cnt);
+  if (mid == 0)
+    return false;
+
+  /* As in index_insert(), the old leaf is trimmed last.  If the
+     index can't take the new leaf, empty it again so that
+     dir_readdir() doesn't list its names twice. */
+  leaf_fill (&s->block, s->entries + mid, cnt - mid);
+  if (!write_block (inode, right, &s->block))
+    return false;
+  if (!index_insert (inode, s, s->path.depth - 1, s->hashes[mid], right))
+    {
+      leaf_fill (&s->block, NULL, 0);
+      write_block (inode, right, &s->block);
+      return false;
+    }
+  leaf_fill (&s->block, s->entries, mid);
+  return write_block (inode, leaf, &s->block);
+}
+
+/* Adds NEW to indexed directory INODE, which must not already
+   contain its name.  Returns true if successful, false on
+   failure. */
+static bool
+index_add (struct inode *inode, const struct dir_entry *new)
+{
+  struct dir_scratch *s = malloc (sizeof *s);
+  uint32_t leaf;
+  bool success = false;
+  size_t i;
+
+  if (s == NULL)
+    return false;
+  leaf = index_descend (inode, hash_string (new->name), &s->block, &s->path);
+  if (leaf != 0)
+    {
+      for (i = 0; i < DIR_LEAF_ENTRIES; i++)
+        if (!s->block.leaf.entries[i].in_use)
+          break;
+      if (i < DIR_LEAF_ENTRIES)
+        success = inode_write_at (inode, new, sizeof *new,
+                                  leaf_ofs (leaf, i)) == sizeof *new;
+      else
+        success = leaf_split (inode, s, leaf, new);
+    }
+  free (s);
+  return success && index_count (inode, 1);
+}
+
+/* Reads the next name in indexed directory DIR, like
+   dir_readdir(), by walking its leaves in block order. */
+static bool
+index_readdir (struct dir *dir, char name[NAME_MAX + 1])
+{
+  off_t length = inode_length (dir->inode);
+
+  if (dir->pos < BLOCK_SECTOR_SIZE)
+    dir->pos = BLOCK_SECTOR_SIZE;
+  while (dir->pos < length)
+    {
+      uint32_t block = dir->pos / BLOCK_SECTOR_SIZE;
+      struct dir_entry e;
+      uint32_t magic;
+
+      if (dir->pos < leaf_ofs (block, 0))
+        {
+          if (inode_read_at (dir->inode, &magic, sizeof magic,
+                             (off_t) block * BLOCK_SECTOR_SIZE) != sizeof magic)
+            return false;
+          dir->pos = (magic == DIR_LEAF_MAGIC
+                      ? leaf_ofs (block, 0)
+                      : (off_t) (block + 1) * BLOCK_SECTOR_SIZE);
+          continue;
+        }
+      if (dir->pos >= leaf_ofs (block, DIR_LEAF_ENTRIES))
+        {
+          dir->pos = (off_t) (block + 1) * BLOCK_SECTOR_SIZE;
+          continue;
+        }
+      if (inode_read_at (dir->inode, &e, sizeof e, dir->pos) != sizeof e)
+        return false;
+      dir->pos += sizeof e;
+      if (e.in_use)
+        {
+          strlcpy (name, e.name, NAME_MAX + 1);
+          return true;
+        }
+    }
+  return false;
+}
+
 /* Searches DIR for a file with the given NAME.
    If successful, returns true, sets *EP to the directory entry
    if EP is non-null, and sets *OFSP to the byte offset of the
@@ -99,6 +641,8 @@ lookup (const struct dir *dir, const char *name,
   ASSERT (dir != NULL);
   ASSERT (name != NULL);
 
+  if (is_indexed (dir->inode))
+    return index_lookup (dir->inode, name, ep, ofsp);
   for (ofs = 0; inode_read_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
        ofs += sizeof e) 
     if (e.in_use && !strcmp (name, e.name)) 
@@ -120,15 +664,25 @@ bool
 dir_lookup (const struct dir *dir, const char *name,
             struct inode **inode) 
 {
+  block_sector_t parent, sector;
   struct dir_entry e;
 
   ASSERT (dir != NULL);
   ASSERT (name != NULL);
 
-  if (lookup (dir, name, &e, NULL))
-    *inode = inode_open (e.inode_sector);
-  else
-    *inode = NULL;
+  parent = inode_get_inumber (dir->inode);
+
+  /* Adding to an indexed directory moves entries between leaves,
+     so don't look while that happens.  Holding the lock also
+     keeps the dentry cache in step with the directory. */
+  inode_lock (dir->inode);
+  if (!dcache_lookup (parent, name, &sector))
+    {
+      sector = lookup (dir, name, &e, NULL) ? e.inode_sector : DCACHE_NEGATIVE;
+      dcache_insert (parent, name, sector);
+    }
+  *inode = sector != DCACHE_NEGATIVE ? inode_open (sector) : NULL;
+  inode_unlock (dir->inode);
 
   return *inode != NULL;
 }
@@ -164,6 +718,16 @@ dir_add (struct dir *dir, const char *name, block_sector_t inode_sector)
   {
       goto done;
   }
+
+  if (is_indexed (dir->inode))
+    {
+      memset (&e, 0, sizeof e);
+      e.in_use = true;
+      strlcpy (e.name, name, sizeof e.name);
+      e.inode_sector = inode_sector;
+      success = index_add (dir->inode, &e);
+      goto done;
+    }
   
   /* Set OFS to offset of free slot.
      If there are no free slots, then it will be set to the
@@ -184,6 +748,8 @@ dir_add (struct dir *dir, const char *name, block_sector_t inode_sector)
   success = inode_write_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
 
  done:
+  if (success)
+    dcache_insert (inode_get_inumber (dir->inode), name, inode_sector);
   inode_unlock (dir_get_inode(dir));
   return success;
 }
@@ -222,6 +788,11 @@ dir_remove (struct dir *dir, const char *name)
   e.in_use = false;
   if (inode_write_at (dir->inode, &e, sizeof e, ofs) != sizeof e) 
     goto done;
+  dcache_invalidate (inode_get_inumber (dir->inode), name);
+  if (inode_is_dir (inode))
+    dcache_invalidate_dir (e.inode_sector);
+  if (is_indexed (dir->inode) && !index_count (dir->inode, -1))
+    goto done;
 
   /* Remove inode. */
   inode_remove (inode);
@@ -240,17 +811,24 @@ bool
 dir_readdir (struct dir *dir, char name[NAME_MAX + 1])
 {
   struct dir_entry e;
+  bool found = false;
 
-  while (inode_read_at (dir->inode, &e, sizeof e, dir->pos) == sizeof e) 
-    {
-      dir->pos += sizeof e;
-      if (e.in_use)
-        {
-          strlcpy (name, e.name, NAME_MAX + 1);
-          return true;
-        } 
-    }
-  return false;
+  inode_lock (dir->inode);
+  if (is_indexed (dir->inode))
+    found = index_readdir (dir, name);
+  else
+    while (inode_read_at (dir->inode, &e, sizeof e, dir->pos) == sizeof e) 
+      {
+        dir->pos += sizeof e;
+        if (e.in_use)
+          {
+            strlcpy (name, e.name, NAME_MAX + 1);
+            found = true;
+            break;
+          } 
+      }
+  inode_unlock (dir->inode);
+  return found;
 }
 
 
@@ -280,14 +858,26 @@ bool dir_is_empty (struct inode *inode)
 {
   struct dir_entry e;
   off_t pos = 0;
+  bool empty = true;
 
-  while (inode_read_at (inode, &e, sizeof e, pos) == sizeof e) 
+  inode_lock (inode);
+  if (is_indexed (inode))
     {
-      pos += sizeof e;
-      if (e.in_use)
-        {
-          return false;
-        } 
+      uint32_t cnt;
+      empty = (inode_read_at (inode, &cnt, sizeof cnt,
+                              offsetof (struct dir_node, entry_cnt)) == sizeof cnt
+               && cnt == 0);
     }
-  return true;
+  else
+    while (inode_read_at (inode, &e, sizeof e, pos) == sizeof e) 
+      {
+        pos += sizeof e;
+        if (e.in_use)
+          {
+            empty = false;
+            break;
+          } 
+      }
+  inode_unlock (inode);
+  return empty;
 }
@@ -4,6 +4,7 @@
 #include <stdbool.h>
 #include <stddef.h>
 #include "devices/block.h"
+#include "filesys/off_t.h"
 
 /* Maximum length of a file name component.
    This is the traditional UNIX maximum length.
@@ -14,6 +15,7 @@
 struct inode;
 
 /* Opening and closing directories. */
+bool dir_set_format (const char *name);
 bool dir_create (block_sector_t sector, size_t entry_cnt);
 struct dir *dir_open (struct inode *);
 struct dir *dir_open_root (void);
@@ -27,6 +29,10 @@ bool dir_add (struct dir *, const char *name, block_sector_t);
 bool dir_remove (struct dir *, const char *name);
 bool dir_readdir (struct dir *, char name[NAME_MAX + 1]);
 
+/* Position of dir_readdir(). */
+void dir_seek (struct dir *, off_t);
+off_t dir_tell (struct dir *);
+
 bool
 dir_get_parent (struct dir* dir, struct inode **inode);
 
@@ -140,6 +140,15 @@ file_allow_write (struct file *file)
     }
 }
 
+/* Returns true if file_deny_write() was called on FILE and
+   file_allow_write() has not been since. */
+bool
+file_write_denied (struct file *file)
+{
+  ASSERT (file != NULL);
+  return file->deny_write;
+}
+
 /* Returns the size of FILE in bytes. */
 off_t
 file_length (struct file *file) 
@@ -1,6 +1,7 @@
 #ifndef FILESYS_FILE_H
 #define FILESYS_FILE_H
 
+#include <stdbool.h>
 #include "filesys/off_t.h"
 
 struct inode;
@@ -20,6 +21,7 @@ off_t file_write_at (struct file *, const void *, off_t size, off_t start);
 /* Preventing writes. */
 void file_deny_write (struct file *);
 void file_allow_write (struct file *);
+bool file_write_denied (struct file *);
 
 /* File position. */
 void file_seek (struct file *, off_t);
@@ -7,6 +7,7 @@
 #include "filesys/inode.h"
 #include "filesys/directory.h"
 #include "filesys/cache.h"
+#include "filesys/dcache.h"
 #include "threads/thread.h"
 #include "threads/malloc.h"
 /* Partition that contains the file system. */
@@ -30,9 +31,12 @@ filesys_init (bool format)
   free_map_init ();
   //for project 4
   cache_init ();  
+  dcache_init ();
 
   if (format) 
     do_format ();
+  else
+    inode_use_format_of (ROOT_DIR_SECTOR);
 
   free_map_open ();
 }
@@ -61,8 +65,11 @@ filesys_create (const char *name, off_t initial_size, bool isdir)
   if (strcmp (filename, ".") != 0 && strcmp (filename, "..") !=0 ) 
   { 
       success = (dir != NULL
-                  && free_map_allocate (1, &inode_sector)
-                  && inode_create (inode_sector, initial_size, isdir)
+                  && free_map_allocate_near (inode_get_inumber (dir_get_inode (dir)),
+                                             1, &inode_sector)
+                  && (isdir
+                      ? dir_create (inode_sector, 0)
+                      : inode_create (inode_sector, initial_size, false))
                   && dir_add (dir, filename, inode_sector));
   } 
  if (!success && inode_sector != 0) 
@@ -1,5 +1,6 @@
 #include "filesys/fsutil.h"
 #include <debug.h>
+#include <round.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -11,6 +12,10 @@
 #include "threads/palloc.h"
 #include "threads/vaddr.h"
 
+/* Number of sectors fsutil_extract() reads from the scratch
+   device at once. */
+#define EXTRACT_SECTORS 16
+
 /* List files in the root directory. */
 void
 fsutil_ls (char **argv UNUSED) 
@@ -75,12 +80,16 @@ fsutil_extract (char **argv UNUSED)
 
   struct block *src;
   void *header, *data;
+  void *data_sectors[EXTRACT_SECTORS];
+  size_t i;
 
   /* Allocate buffers. */
   header = malloc (BLOCK_SECTOR_SIZE);
-  data = malloc (BLOCK_SECTOR_SIZE);
+  data = malloc (EXTRACT_SECTORS * BLOCK_SECTOR_SIZE);
   if (header == NULL || data == NULL)
     PANIC ("couldn't allocate buffers");
+  for (i = 0; i < EXTRACT_SECTORS; i++)
+    data_sectors[i] = (uint8_t *) data + i * BLOCK_SECTOR_SIZE;
 
   /* Open source block device. */
   src = block_get_role (BLOCK_SCRATCH);
@@ -123,13 +132,16 @@ fsutil_extract (char **argv UNUSED)
           if (dst == NULL)
             PANIC ("%s: open failed", file_name);
 
-          /* Do copy. */
+          /* Do copy, up to EXTRACT_SECTORS sectors at a time. */
           while (size > 0)
             {
-              int chunk_size = (size > BLOCK_SECTOR_SIZE
-                                ? BLOCK_SECTOR_SIZE
+              int chunk_size = (size > EXTRACT_SECTORS * BLOCK_SECTOR_SIZE
+                                ? EXTRACT_SECTORS * BLOCK_SECTOR_SIZE
                                 : size);
-              block_read (src, sector++, data);
+              size_t chunk_sectors = DIV_ROUND_UP (chunk_size,
+                                                   BLOCK_SECTOR_SIZE);
+              block_read_multiple (src, sector, chunk_sectors, data_sectors);
+              sector += chunk_sectors;
               if (file_write (dst, data, chunk_size) != chunk_size)
                 PANIC ("%s: write failed with %d bytes unwritten",
                        file_name, size);
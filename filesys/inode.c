@@ -1,4 +1,5 @@
 #include "filesys/inode.h"
+#include <hash.h>
 #include <list.h>
 #include <debug.h>
 #include <round.h>
@@ -13,7 +14,30 @@
 
 /*************************************************/
 
+/* Layouts of a file's data on disk.  The layout of new inodes is
+   chosen when the file system is formatted. */
+enum inode_format
+  {
+    INODE_INDEXED,                      /* Direct and indirect pointers. */
+    INODE_EXTENT                        /* Runs of consecutive sectors. */
+  };
+
+/* Extents kept in the inode itself, and in each extent block. */
+#define INODE_EXTENTS 51
+#define EXTENT_BLOCK_EXTENTS 63
+
+/* A run of LENGTH consecutive sectors starting at START. */
+struct inode_extent
+  {
+    block_sector_t start;
+    uint32_t length;
+  };
 
+/* Indirect blocks whose pointers an open inode remembers. */
+#define MAP_CACHE_SIZE 4
+
+/* Sectors reserved at a time for a growing inode. */
+#define PREALLOC_WINDOW 16
 
 /* On-disk inode.
    Must be exactly BLOCK_SECTOR_SIZE bytes long. */
@@ -30,10 +54,27 @@ struct inode_disk
       uint32_t double_indirect_index;
       bool isDir;
       block_sector_t parent;
-      uint32_t unused[107];
+      uint32_t format;                    /* enum inode_format. */
+      uint32_t extent_cnt;                /* Number of extents. */
+      block_sector_t extent_head;         /* First extent block, or 0. */
+      block_sector_t extent_tail;         /* Last extent block, or 0. */
+      block_sector_t extent_end;          /* Sector after the last extent. */
+      struct inode_extent extents[INODE_EXTENTS]; /* First extents. */
       block_sector_t pointer[14];
   };
 
+/*
+ * Extents past the first INODE_EXTENTS of a file, in a chain of
+ * blocks.  Sector 0 holds the free map inode, so a zero NEXT ends
+ * the chain.
+ */
+struct extent_block
+  {
+    uint32_t extent_cnt;
+    block_sector_t next;
+    struct inode_extent extents[EXTENT_BLOCK_EXTENTS];
+  };
+
 /*
  * Indirect block, which are used to store pointers that point ot 
  * other data block
@@ -72,12 +113,20 @@ bytes_to_double_indirect_sector (off_t size)
    return 1;
 }
 
+/* What open_inodes is keyed on, kept apart from the rest of
+   struct inode so that a lookup needs only this much on the stack. */
+struct inode_key
+  {
+    struct hash_elem elem;              /* Element in open_inodes. */
+    block_sector_t sector;              /* Sector number of disk location. */
+  };
+
 /* In-memory inode. */
 struct inode 
   {
-    struct list_elem elem;              /* Element in inode list. */
-    block_sector_t sector;              /* Sector number of disk location. */
+    struct inode_key key;               /* Sector and open_inodes element. */
     int open_cnt;                       /* Number of openers. */
+    bool closing;                       /* Being written back by last closer. */
     bool removed;                       /* True if deleted, false otherwise. */
     int deny_write_cnt;                 /* 0: writes ok, >0: deny writes. */
   //  struct inode_disk data;             /* Inode content. */
@@ -90,9 +139,38 @@ struct inode
     block_sector_t parent;
     struct lock inode_lock;
     block_sector_t pointer[14];
+    enum inode_format format;           /* Layout of the data. */
+    size_t extent_cnt;                  /* Extents, as in inode_disk. */
+    block_sector_t extent_head;
+    block_sector_t extent_tail;
+    block_sector_t extent_end;
+    struct inode_extent extents[INODE_EXTENTS];
+    struct lock map_lock;               /* Protects the map cache. */
+    size_t map_first[MAP_CACHE_SIZE];   /* First file sector of each entry. */
+    size_t map_cnt[MAP_CACHE_SIZE];     /* File sectors it maps, 0 if none. */
+    block_sector_t *map_sectors[MAP_CACHE_SIZE]; /* Its data sectors. */
+    size_t map_next;                    /* Entry to replace next. */
+    block_sector_t alloc_goal;          /* Where to allocate next, 0 if unknown. */
+    block_sector_t prealloc_start;      /* Sectors reserved for growth. */
+    size_t prealloc_cnt;
+    off_t ra_next;                      /* Where a sequential read resumes. */
+    off_t ra_end;                       /* End of the range read ahead. */
+    size_t ra_window;                   /* Sectors to read ahead. */
 
    };
 /**************methods *******************/
+static bool
+inode_alloc_sector (struct inode *inode, block_sector_t *sectorp);
+static size_t
+inode_alloc_run (struct inode *inode, size_t want, block_sector_t *start);
+static void
+inode_prealloc_release (struct inode *inode);
+static off_t
+inode_expand_extents (struct inode *inode, off_t length);
+static off_t
+inode_expand_short (off_t length, size_t missing);
+static void
+inode_dealloc_extents (struct inode *inode);
 bool
 inode_dealloc (struct inode *inode);
 void
@@ -116,6 +194,165 @@ inode_unlock (const struct inode *inode)
 {
     lock_release(&((struct inode *)inode)->inode_lock);
 }
+/* Reads metadata sector SECTOR, an inode or an indirect or extent
+   block, into BUFFER through the buffer cache. */
+static void
+meta_read (block_sector_t sector, void *buffer)
+{
+  struct cache_block *c = cache_block_open (sector, CACHE_META);
+  memcpy (buffer, c->block, BLOCK_SECTOR_SIZE);
+  cache_block_put (c);
+}
+
+/* Writes BUFFER to metadata sector SECTOR through the buffer
+   cache. */
+static void
+meta_write (block_sector_t sector, const void *buffer)
+{
+  struct cache_block *c = cache_block_open (sector, CACHE_WRITE | CACHE_META
+                                                    | CACHE_NOREAD);
+  memcpy (c->block, buffer, BLOCK_SECTOR_SIZE);
+  cache_block_put (c);
+}
+
+/* Returns pointer I of the indirect block in SECTOR, looked up in
+   place in the buffer cache. */
+static block_sector_t
+read_pointer (block_sector_t sector, size_t i)
+{
+  struct cache_block *c = cache_block_open (sector, CACHE_META);
+  block_sector_t ptr = ((const block_sector_t *) c->block)[i];
+  cache_block_put (c);
+  return ptr;
+}
+
+/* Returns the sector holding sector IDX of the data of INODE,
+   which uses extents, or -1 if there is none.  Extent blocks are
+   searched in place in the buffer cache. */
+static block_sector_t
+extent_to_sector (const struct inode *inode, size_t idx)
+{
+  block_sector_t next, sector = -1;
+  size_t i;
+
+  for (i = 0; i < inode->extent_cnt && i < INODE_EXTENTS; i++)
+    {
+      if (idx < inode->extents[i].length)
+        return inode->extents[i].start + idx;
+      idx -= inode->extents[i].length;
+    }
+  for (next = inode->extent_head; next != 0 && sector == (block_sector_t) -1; )
+    {
+      struct cache_block *c = cache_block_open (next, CACHE_META);
+      const struct extent_block *block = (const struct extent_block *) c->block;
+      for (i = 0; i < block->extent_cnt; i++)
+        {
+          if (idx < block->extents[i].length)
+            {
+              sector = block->extents[i].start + idx;
+              break;
+            }
+          idx -= block->extents[i].length;
+        }
+      next = block->next;
+      cache_block_put (c);
+    }
+  return sector;
+}
+
+/* Initializes the map cache of INODE. */
+static void
+inode_map_init (struct inode *inode)
+{
+  size_t i;
+
+  lock_init (&inode->map_lock);
+  for (i = 0; i < MAP_CACHE_SIZE; i++)
+    {
+      inode->map_cnt[i] = 0;
+      inode->map_sectors[i] = NULL;
+    }
+  inode->map_next = 0;
+}
+
+/* Forgets the indirect blocks remembered by INODE, whose blocks
+   are being released. */
+static void
+inode_map_invalidate (struct inode *inode)
+{
+  size_t i;
+
+  lock_acquire (&inode->map_lock);
+  for (i = 0; i < MAP_CACHE_SIZE; i++)
+    inode->map_cnt[i] = 0;
+  lock_release (&inode->map_lock);
+}
+
+/* Frees the map cache of INODE. */
+static void
+inode_map_free (struct inode *inode)
+{
+  size_t i;
+
+  for (i = 0; i < MAP_CACHE_SIZE; i++)
+    free (inode->map_sectors[i]);
+}
+
+/* Returns the data sector of file sector IDX of INODE, an indexed
+   inode LENGTH bytes long, where IDX is past the direct pointers.
+
+   The pointers of the last few indirect blocks used are kept in
+   INODE's map cache, so a sequential scan reads each indirect
+   block once instead of once per sector.  An entry only covers the
+   sectors that were inside LENGTH when it was loaded.  Those never
+   move while the file grows, so growth needs no invalidation; a
+   lookup past them just loads the entry again. */
+static block_sector_t
+indirect_to_sector (struct inode *inode, off_t length, size_t idx)
+{
+  size_t group = (idx - 4) / 128;
+  size_t first = 4 + group * 128;
+  size_t mapped = bytes_to_sectors (length) - first;
+  block_sector_t sector;
+  size_t i;
+
+  lock_acquire (&inode->map_lock);
+  for (i = 0; i < MAP_CACHE_SIZE; i++)
+    if (inode->map_cnt[i] > 0 && inode->map_first[i] == first)
+      {
+        if (idx - first < inode->map_cnt[i])
+          {
+            sector = inode->map_sectors[i][idx - first];
+            lock_release (&inode->map_lock);
+            return sector;
+          }
+        break;
+      }
+  if (i == MAP_CACHE_SIZE)
+    {
+      i = inode->map_next;
+      inode->map_next = (i + 1) % MAP_CACHE_SIZE;
+    }
+
+  /* Find the indirect block and load it into entry I. */
+  sector = group < 9 ? inode->pointer[4 + group]
+                     : read_pointer (inode->pointer[13], group - 9);
+  inode->map_cnt[i] = 0;
+  if (inode->map_sectors[i] == NULL)
+    inode->map_sectors[i] = malloc (BLOCK_SECTOR_SIZE);
+  if (inode->map_sectors[i] != NULL)
+    {
+      meta_read (sector, inode->map_sectors[i]);
+      inode->map_first[i] = first;
+      inode->map_cnt[i] = mapped < 128 ? mapped : 128;
+      sector = inode->map_sectors[i][idx - first];
+    }
+  else
+    sector = read_pointer (sector, idx - first);
+  lock_release (&inode->map_lock);
+  return sector;
+}
+
 /* Returns the block device sector that contains byte offset POS
    within INODE.
    Returns -1 if INODE does not contain data for a byte at offset
@@ -131,28 +368,16 @@ byte_to_sector (const struct inode *inode, off_t length,  off_t pos)
  */
   if (pos < length)
   {
-     uint32_t index;
-     uint32_t indirect_block[128];
-     if (pos < BLOCK_SECTOR_SIZE * 4)
-     {
-         return inode->pointer[pos/BLOCK_SECTOR_SIZE];
-     }else if (pos < BLOCK_SECTOR_SIZE * (4 + 9 * 128))
+     if (inode->format == INODE_EXTENT)
      {
-         pos -= BLOCK_SECTOR_SIZE * 4;
-	 index = pos / (BLOCK_SECTOR_SIZE * 128) + 4;
-	 block_read (fs_device, inode->pointer[index], &indirect_block);
-         pos %= BLOCK_SECTOR_SIZE * 128;
-         return indirect_block[pos / BLOCK_SECTOR_SIZE];
+         return extent_to_sector (inode, pos / BLOCK_SECTOR_SIZE);
      }
-     else
+     if (pos < BLOCK_SECTOR_SIZE * 4)
      {
-	block_read (fs_device, inode->pointer[13], &indirect_block);
-        pos -= BLOCK_SECTOR_SIZE * (4 + 9 * 128);
-        index = pos / (BLOCK_SECTOR_SIZE * 128);
-        block_read (fs_device, indirect_block[index], &indirect_block);
-        pos %= BLOCK_SECTOR_SIZE * 128;
-        return indirect_block[pos/BLOCK_SECTOR_SIZE];
+         return inode->pointer[pos/BLOCK_SECTOR_SIZE];
      }
+     return indirect_to_sector ((struct inode *) inode, length,
+                                pos / BLOCK_SECTOR_SIZE);
   }
     else
     {
@@ -161,70 +386,206 @@ byte_to_sector (const struct inode *inode, off_t length,  off_t pos)
 
 }
 
-/* List of open inodes, so that opening a single inode twice
-   returns the same `struct inode'. */
-static struct list open_inodes;
+/* Open inodes, indexed by sector, so that opening a single inode
+   twice returns the same `struct inode'.  OPEN_INODES_LOCK
+   protects the table and the open_cnt, closing, deny_write_cnt and
+   removed members of every inode in it.  It is also held while the
+   first opener reads an inode.  The last closer writes the inode
+   back without it, but leaves the inode in the table marked
+   `closing' until the write is done; an opener that finds a closing
+   inode waits on INODE_CLOSED, so nobody can read a sector whose
+   newest contents are still in memory.  Each inode's own inode_lock
+   serializes growing the file, or for a directory, every change to
+   its entries. */
+static struct hash open_inodes;
+static struct lock open_inodes_lock;
+static struct condition inode_closed;
+
+static unsigned open_inode_hash (const struct hash_elem *, void *);
+static bool open_inode_less (const struct hash_elem *,
+                             const struct hash_elem *, void *);
+
+/* Layout given to new inodes. */
+static enum inode_format inode_format = INODE_INDEXED;
 
 /* Initializes the inode module. */
 void
 inode_init (void) 
 {
-  list_init (&open_inodes);
+  hash_init (&open_inodes, open_inode_hash, open_inode_less, NULL);
+  lock_init (&open_inodes_lock);
+  cond_init (&inode_closed);
+}
+
+/* Returns a hash of the sector of an open inode. */
+static unsigned
+open_inode_hash (const struct hash_elem *e, void *aux UNUSED)
+{
+  return hash_int (hash_entry (e, struct inode_key, elem)->sector);
+}
+
+/* Returns true if open inode A's sector precedes B's. */
+static bool
+open_inode_less (const struct hash_elem *a, const struct hash_elem *b,
+                 void *aux UNUSED)
+{
+  return (hash_entry (a, struct inode_key, elem)->sector
+          < hash_entry (b, struct inode_key, elem)->sector);
+}
+
+/* Selects the layout of inodes created from now on by NAME,
+   "indexed" or "extent".  Returns false if NAME is unknown. */
+bool
+inode_set_format (const char *name)
+{
+  if (!strcmp (name, "indexed"))
+    inode_format = INODE_INDEXED;
+  else if (!strcmp (name, "extent"))
+    inode_format = INODE_EXTENT;
+  else
+    return false;
+  return true;
+}
+
+/* Makes inodes created from now on use the layout of the inode in
+   SECTOR, so a file system keeps the layout it was formatted
+   with. */
+void
+inode_use_format_of (block_sector_t sector)
+{
+  struct inode_disk data;
+
+  meta_read (sector, &data);
+  if (data.magic == INODE_MAGIC)
+    inode_format = data.format;
+}
+
+/* Fills the CNT newly allocated sectors in SECTORS with zeros.
+   Each run of consecutive sector numbers is zeroed with a single
+   cache_zero(). */
+static void
+inode_zero_sectors (const block_sector_t *sectors, size_t cnt)
+{
+  size_t i, run;
+
+  for (i = 0; i < cnt; i += run)
+    {
+      for (run = 1; i + run < cnt; run++)
+        if (sectors[i + run] != sectors[i] + run)
+          break;
+      cache_zero (sectors[i], run);
+    }
 }
 
 off_t
 inode_expand (struct inode *inode, off_t length)
 {
-    static char zeros[BLOCK_SECTOR_SIZE];
     size_t new_data_sectors = bytes_to_sectors(length)
 			      - bytes_to_sectors(inode->length);
+    size_t first = inode->direct_index;
     if (new_data_sectors == 0)
     {
 	return length;
     }
+    if (inode->format == INODE_EXTENT)
+    {
+	return inode_expand_extents (inode, length);
+    }
     
     while (inode->direct_index < 4)
     {
-	free_map_allocate (1, &inode->pointer[inode->direct_index]);
-	block_write(fs_device, inode->pointer[inode->direct_index], zeros);
+	if (!inode_alloc_sector (inode, &inode->pointer[inode->direct_index]))
+	{
+	    break;
+	}
         inode->direct_index++;
 	new_data_sectors--;
 	if (new_data_sectors == 0)
 	{
-	    return length;
+	    break;
 	}
     }
+    if (inode->direct_index > first && first < 4)
+    {
+	inode_zero_sectors (&inode->pointer[first],
+			    inode->direct_index - first);
+    }
+    if (new_data_sectors == 0)
+    {
+	return length;
+    }
+    /* The disk filled up before the direct pointers ran out. */
+    if (inode->direct_index < 4)
+    {
+	return inode_expand_short (length, new_data_sectors);
+    }
     while (inode->direct_index < 13)
     {
-	new_data_sectors = inode_expand_indirect_block (inode, new_data_sectors);
-	if (new_data_sectors == 0)
+	size_t left = inode_expand_indirect_block (inode, new_data_sectors);
+	if (left == 0)
 	{
 		return length;
 	}
+	if (left == new_data_sectors)
+	{
+		return inode_expand_short (length, new_data_sectors);
+	}
+	new_data_sectors = left;
     }
     if (inode->direct_index == 13)
     {
 	new_data_sectors = inode_expand_double_indirect_block (inode, new_data_sectors);
     }
-    return length - new_data_sectors* BLOCK_SECTOR_SIZE;
+    return inode_expand_short (length, new_data_sectors);
 
 }
 
-/* alloc inode for the specific disk inode */
+/* Returns the length of a file that was meant to grow to LENGTH
+   bytes but is still MISSING data sectors short of it.  The result
+   ends on a sector boundary, so it never cuts into the data the file
+   already had. */
+static off_t
+inode_expand_short (off_t length, size_t missing)
+{
+    if (missing == 0)
+    {
+	return length;
+    }
+    return (off_t) (bytes_to_sectors (length) - missing) * BLOCK_SECTOR_SIZE;
+}
+
+/* alloc inode for the specific disk inode.
+   Returns false, with nothing left allocated, if the disk is full. */
 bool
-inode_allocate (struct inode_disk *disk_inode)
+inode_allocate (block_sector_t sector, struct inode_disk *disk_inode)
 {
      struct inode inode = {
+         .key.sector = sector,
          .length = 0,
 	 .direct_index = 0,
 	 .indirect_index = 0,
 	 .double_indirect_index = 0,
+	 .format = inode_format,
       };
-     inode_expand (&inode, disk_inode->length);
+     off_t length = inode_expand (&inode, disk_inode->length);
+     inode_prealloc_release (&inode);
+     if (length != disk_inode->length)
+     {
+	inode.length = length;
+	inode_map_init (&inode);
+	inode_dealloc (&inode);
+	return false;
+     }
      disk_inode->direct_index = inode.direct_index;
      disk_inode->indirect_index = inode.indirect_index;
      disk_inode->double_indirect_index = inode.double_indirect_index;
      memcpy (&disk_inode->pointer, &inode.pointer, 14 * sizeof(block_sector_t));
+     disk_inode->format = inode.format;
+     disk_inode->extent_cnt = inode.extent_cnt;
+     disk_inode->extent_head = inode.extent_head;
+     disk_inode->extent_tail = inode.extent_tail;
+     disk_inode->extent_end = inode.extent_end;
+     memcpy (&disk_inode->extents, &inode.extents, sizeof inode.extents);
      return true;
 }
 
@@ -255,9 +616,9 @@ inode_create (block_sector_t sector, off_t length, bool isDir)
       disk_inode->magic = INODE_MAGIC;
       disk_inode->isDir = isDir;
       disk_inode->parent = ROOT_DIR_SECTOR;
-      if (inode_allocate(disk_inode))
+      if (inode_allocate(sector, disk_inode))
       {
-          block_write (fs_device, sector, disk_inode);
+          meta_write (sector, disk_inode);
 	  success = true;
       }
       free (disk_inode);
@@ -288,37 +649,51 @@ inode_create (block_sector_t sector, off_t length, bool isDir)
 struct inode *
 inode_open (block_sector_t sector)
 {
-  struct list_elem *e;
+  struct inode_key key;
+  struct hash_elem *e;
   struct inode *inode;
 
-  /* Check whether this inode is already open. */
-  for (e = list_begin (&open_inodes); e != list_end (&open_inodes);
-       e = list_next (e)) 
+  /* Check whether this inode is already open.  If its last closer
+     is still writing it back, wait for that to finish and read it
+     again. */
+  lock_acquire (&open_inodes_lock);
+  key.sector = sector;
+  while ((e = hash_find (&open_inodes, &key.elem)) != NULL
+         && hash_entry (e, struct inode, key.elem)->closing)
+    cond_wait (&inode_closed, &open_inodes_lock);
+  if (e != NULL)
     {
-      inode = list_entry (e, struct inode, elem);
-      if (inode->sector == sector) 
-        {
-          inode_reopen (inode);
-          return inode; 
-        }
+      inode = hash_entry (e, struct inode, key.elem);
+      inode->open_cnt++;
+      lock_release (&open_inodes_lock);
+      return inode;
     }
 
   /* Allocate memory. */
   inode = malloc (sizeof *inode);
   if (inode == NULL)
-    return NULL;
+    {
+      lock_release (&open_inodes_lock);
+      return NULL;
+    }
 
   /* Initialize. */
-  list_push_front (&open_inodes, &inode->elem);
-  inode->sector = sector;
+  inode->key.sector = sector;
   inode->open_cnt = 1;
+  inode->closing = false;
   inode->deny_write_cnt = 0;
   inode->removed = false;
+  hash_insert (&open_inodes, &inode->key.elem);
 /* added code here */
 
   lock_init (&inode->inode_lock);
+  inode_map_init (inode);
+  inode->alloc_goal = 0;
+  inode->prealloc_cnt = 0;
+  inode->ra_next = inode->ra_end = 0;
+  inode->ra_window = 0;
   struct inode_disk data;
-  block_read (fs_device, inode->sector, &data);
+  meta_read (inode->key.sector, &data);
   inode->length = data.length;
   inode->read_length = data.length;
   inode->direct_index = data.direct_index;
@@ -327,6 +702,13 @@ inode_open (block_sector_t sector)
   inode->isDir = data.isDir;
   inode->parent = data.parent;
   memcpy (&inode->pointer, &data.pointer, 14 * sizeof(block_sector_t));
+  inode->format = data.format;
+  inode->extent_cnt = data.extent_cnt;
+  inode->extent_head = data.extent_head;
+  inode->extent_tail = data.extent_tail;
+  inode->extent_end = data.extent_end;
+  memcpy (&inode->extents, &data.extents, sizeof data.extents);
+  lock_release (&open_inodes_lock);
   return inode;
 }
 
@@ -335,7 +717,11 @@ struct inode *
 inode_reopen (struct inode *inode)
 {
   if (inode != NULL)
-    inode->open_cnt++;
+    {
+      lock_acquire (&open_inodes_lock);
+      inode->open_cnt++;
+      lock_release (&open_inodes_lock);
+    }
   return inode;
 }
 
@@ -343,7 +729,7 @@ inode_reopen (struct inode *inode)
 block_sector_t
 inode_get_inumber (const struct inode *inode)
 {
-  return inode->sector;
+  return inode->key.sector;
 }
 
 /* Closes INODE and writes it to disk.
@@ -356,36 +742,61 @@ inode_close (struct inode *inode)
   if (inode == NULL)
     return;
 
-  /* Release resources if this was the last opener. */
-  if (--inode->open_cnt == 0)
+  /* Release resources if this was the last opener.  The inode is
+     written back before it leaves the table, so the next opener
+     reads what we wrote, but without holding open_inodes_lock:
+     openers of this sector wait for us instead. */
+  lock_acquire (&open_inodes_lock);
+  if (--inode->open_cnt > 0)
     {
-      /* Remove from inode list and release lock. */
-      list_remove (&inode->elem);
- 
-      /* Deallocate blocks if removed. */
-      if (inode->removed) 
-        {
-          free_map_release (inode->sector, 1);
- //         free_map_release (inode->data.start,
- //                           bytes_to_sectors (inode->data.length)); 
-           inode_dealloc(inode);
-        }else
-        {
-            struct inode_disk disk_inode = {
-    		.length = inode->length,
-		.magic = INODE_MAGIC,
-		.direct_index = inode->direct_index,
-		.indirect_index = inode->indirect_index,
-		.double_indirect_index = inode->double_indirect_index,
-		.isDir = inode->isDir,
-		.parent = inode->parent,
-	     };
-	    memcpy (&disk_inode.pointer, &inode->pointer, 14 * sizeof (block_sector_t));
-            block_write (fs_device, inode->sector, &disk_inode);
-        }
+      lock_release (&open_inodes_lock);
+      return;
+    }
+  if (inode->removed)
+    {
+      hash_delete (&open_inodes, &inode->key.elem);
+      lock_release (&open_inodes_lock);
+    }
+  else
+    {
+      struct inode_disk disk_inode = {
+        .length = inode->length,
+        .magic = INODE_MAGIC,
+        .direct_index = inode->direct_index,
+        .indirect_index = inode->indirect_index,
+        .double_indirect_index = inode->double_indirect_index,
+        .isDir = inode->isDir,
+        .parent = inode->parent,
+        .format = inode->format,
+        .extent_cnt = inode->extent_cnt,
+        .extent_head = inode->extent_head,
+        .extent_tail = inode->extent_tail,
+        .extent_end = inode->extent_end,
+      };
+      memcpy (&disk_inode.pointer, &inode->pointer, 14 * sizeof (block_sector_t));
+      memcpy (&disk_inode.extents, &inode->extents, sizeof inode->extents);
+      inode->closing = true;
+      lock_release (&open_inodes_lock);
+      meta_write (inode->key.sector, &disk_inode);
+
+      lock_acquire (&open_inodes_lock);
+      hash_delete (&open_inodes, &inode->key.elem);
+      cond_broadcast (&inode_closed, &open_inodes_lock);
+      lock_release (&open_inodes_lock);
+    }
+  inode_prealloc_release (inode);
 
-      free (inode); 
+  /* Deallocate blocks if removed.  The inode's own sector goes
+     last, so it can't be reused and opened while its blocks are
+     still being freed. */
+  if (inode->removed)
+    {
+      inode_dealloc (inode);
+      free_map_release (inode->key.sector, 1);
     }
+
+  inode_map_free (inode);
+  free (inode);
 }
 
 /* Marks INODE to be deleted when it is closed by the last caller who
@@ -394,7 +805,51 @@ void
 inode_remove (struct inode *inode) 
 {
   ASSERT (inode != NULL);
+  lock_acquire (&open_inodes_lock);
   inode->removed = true;
+  lock_release (&open_inodes_lock);
+}
+
+/* Called after bytes START through END of INODE, which is LENGTH
+   bytes long, were read.  A read that starts where the last one
+   stopped doubles the read-ahead window, up to READ_AHEAD_MAX
+   sectors; any other read closes it, except one from the start
+   of the file that reaches past its first sector.  Short probes of
+   a file's header, such as a directory's magic number or an ELF
+   header, thus queue nothing.  Sectors inside the window
+   that were not asked for yet are queued for the cache's
+   read-ahead thread.  Concurrent readers may race on these fields,
+   which only makes the guess worse. */
+static void
+inode_read_ahead (struct inode *inode, off_t length, off_t start, off_t end)
+{
+  off_t pos, limit;
+
+  if (start != 0 && start == inode->ra_next)
+    inode->ra_window = inode->ra_window == 0 ? 1
+                       : inode->ra_window * 2 < READ_AHEAD_MAX
+                       ? inode->ra_window * 2 : READ_AHEAD_MAX;
+  else
+    {
+      /* Reading from the start of the file counts as sequential. */
+      inode->ra_window = start == 0 && end >= BLOCK_SECTOR_SIZE ? 1 : 0;
+      inode->ra_end = end;
+    }
+  inode->ra_next = end;
+  if (inode->ra_window == 0)
+    return;
+
+  limit = ROUND_UP (end, BLOCK_SECTOR_SIZE)
+          + (off_t) inode->ra_window * BLOCK_SECTOR_SIZE;
+  if (limit > length)
+    limit = length;
+  pos = ROUND_UP (end, BLOCK_SECTOR_SIZE);
+  if (pos < inode->ra_end)
+    pos = inode->ra_end;
+  for (; pos < limit; pos += BLOCK_SECTOR_SIZE)
+    cache_read_ahead (byte_to_sector (inode, length, pos));
+  if (pos > inode->ra_end)
+    inode->ra_end = pos;
 }
 
 /* Reads SIZE bytes from INODE into BUFFER, starting at position OFFSET.
@@ -449,15 +904,15 @@ inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset)
         }
 */      
      struct cache_block *c = cache_block_get (sector_idx, false);
-     memcpy (buffer+bytes_read, (uint8_t *)&c->block+sector_ofs, chunk_size);
-     c->accessed = true;
-     c->open_cnt--;   
+     memcpy (buffer+bytes_read, c->block + sector_ofs, chunk_size);
+     cache_block_put (c);
      /* Advance. */
       size -= chunk_size;
       offset += chunk_size;
       bytes_read += chunk_size;
     }
 //  free (bounce);
+  inode_read_ahead (inode, length, offset - bytes_read, offset);
 
   return bytes_read;
 }
@@ -477,13 +932,17 @@ inode_write_at (struct inode *inode, const void *buffer_, off_t size,
 
   if (inode->deny_write_cnt)
     return 0;
+  /* Directories are only written with their lock held already.
+     Another writer may have extended the file while we waited for
+     the lock, so check again once we hold it. */
   if (offset + size > inode_length (inode))
   {
 	if (!inode->isDir)
 	    {
 		inode_lock(inode);
 	    }
-	inode->length = inode_expand (inode, offset+size);
+	if (offset + size > inode_length (inode))
+	    inode->length = inode_expand (inode, offset+size);
 	if (!inode->isDir)
 	  {
 		inode_unlock(inode);
@@ -529,10 +988,8 @@ inode_write_at (struct inode *inode, const void *buffer_, off_t size,
 //          else
 //            memset (bounce, 0, BLOCK_SECTOR_SIZE);
           struct cache_block *c = cache_block_get (sector_idx, true);
-          memcpy ((uint8_t *)&c->block+sector_ofs,buffer+bytes_written,  chunk_size);
-          c->accessed = true;
-  	  c->dirty = true;
- 	  c->open_cnt--;
+          memcpy (c->block + sector_ofs,buffer+bytes_written,  chunk_size);
+          cache_block_put (c);
 //          block_write (fs_device, sector_idx, bounce);
 //        }
 
@@ -551,8 +1008,10 @@ inode_write_at (struct inode *inode, const void *buffer_, off_t size,
 void
 inode_deny_write (struct inode *inode) 
 {
+  lock_acquire (&open_inodes_lock);
   inode->deny_write_cnt++;
   ASSERT (inode->deny_write_cnt <= inode->open_cnt);
+  lock_release (&open_inodes_lock);
 }
 
 /* Re-enables writes to INODE.
@@ -561,9 +1020,11 @@ inode_deny_write (struct inode *inode)
 void
 inode_allow_write (struct inode *inode) 
 {
+  lock_acquire (&open_inodes_lock);
   ASSERT (inode->deny_write_cnt > 0);
   ASSERT (inode->deny_write_cnt <= inode->open_cnt);
   inode->deny_write_cnt--;
+  lock_release (&open_inodes_lock);
 }
 
 /* Returns the length, in bytes, of INODE's data. */
@@ -578,7 +1039,7 @@ inode_dealloc_indirect_block (block_sector_t *ptr, size_t data_ptrs)
 {
      unsigned int i;
      struct indirect_block block;
-     block_read(fs_device, *ptr, &block);
+     meta_read (*ptr, &block);
      for (i = 0; i < data_ptrs; i++)
      {
 	free_map_release (block.ptr[i],1);
@@ -590,7 +1051,7 @@ inode_dealloc_double_indirect_block (block_sector_t *ptr, size_t indirect_ptrs,s
 {
      unsigned int i;
      struct indirect_block block;
-     block_read(fs_device, *ptr, &block);
+     meta_read (*ptr, &block);
      for (i = 0; i < indirect_ptrs; i++)
      {
          size_t data_per_block = data_ptrs < 128 ? data_ptrs : 128;
@@ -609,6 +1070,12 @@ inode_dealloc (struct inode *inode)
     size_t indirect_sectors = bytes_to_indirect_sectors(inode->length);
     size_t double_indirect_sector = bytes_to_double_indirect_sector (inode->length);
     unsigned int index = 0;
+    inode_map_invalidate (inode);
+    if (inode->format == INODE_EXTENT)
+    {
+       inode_dealloc_extents (inode);
+       return true;
+    }
     while (data_sectors && index < 4)
     {
        free_map_release (inode->pointer[index],1);
@@ -632,20 +1099,25 @@ inode_dealloc (struct inode *inode)
 size_t
 inode_expand_indirect_block (struct inode *inode, size_t new_data_sectors)
 {
-     static char zeros[BLOCK_SECTOR_SIZE];
      struct indirect_block block;
+     size_t first = inode->indirect_index;
      if (inode->indirect_index == 0)
      {
-	free_map_allocate (1, &inode->pointer[inode->direct_index]);
+	if (!inode_alloc_sector (inode, &inode->pointer[inode->direct_index]))
+	{
+	    return new_data_sectors;
+	}
      }
      else
      {
-	block_read (fs_device, inode->pointer[inode->direct_index], &block);
+	meta_read (inode->pointer[inode->direct_index], &block);
      }
      while (inode->indirect_index < 128)
      {
-	free_map_allocate (1, &block.ptr[inode->indirect_index]);
-	block_write (fs_device, block.ptr[inode->indirect_index], zeros);
+	if (!inode_alloc_sector (inode, &block.ptr[inode->indirect_index]))
+	{
+	    break;
+	}
 	inode->indirect_index++;
 	new_data_sectors--;
 	if (new_data_sectors == 0)
@@ -653,7 +1125,18 @@ inode_expand_indirect_block (struct inode *inode, size_t new_data_sectors)
 	    break;
 	}
       }
-      block_write (fs_device, inode->pointer[inode->direct_index], &block);
+      /* Disk full before any data sector went in: drop an indirect
+         block that nothing points through. */
+      if (inode->indirect_index == first)
+      {
+	if (first == 0)
+	{
+	    free_map_release (inode->pointer[inode->direct_index], 1);
+	}
+	return new_data_sectors;
+      }
+      inode_zero_sectors (&block.ptr[first], inode->indirect_index - first);
+      meta_write (inode->pointer[inode->direct_index], &block);
       if (inode->indirect_index == 128)
 	{
 	     inode->indirect_index = 0;
@@ -667,22 +1150,27 @@ size_t inode_expand_double_indirect_block_lvl_two (struct inode *inode,
 					   size_t new_data_sectors,
 					   struct indirect_block* outer_block)
 {
-  static char zeros[BLOCK_SECTOR_SIZE];
   struct indirect_block inner_block;
+  size_t first = inode->double_indirect_index;
   if (inode->double_indirect_index == 0)
     {
-      free_map_allocate(1, &outer_block->ptr[inode->indirect_index]);
+      if (!inode_alloc_sector (inode, &outer_block->ptr[inode->indirect_index]))
+	{
+	  return new_data_sectors;
+	}
     }
   else
     {
-      block_read(fs_device, outer_block->ptr[inode->indirect_index],
+      meta_read (outer_block->ptr[inode->indirect_index],
 		 &inner_block);
     }
   while (inode->double_indirect_index < 128)
     {
-      free_map_allocate(1, &inner_block.ptr[inode->double_indirect_index]);
-      block_write(fs_device, inner_block.ptr[inode->double_indirect_index],
-		  zeros);
+      if (!inode_alloc_sector (inode,
+			       &inner_block.ptr[inode->double_indirect_index]))
+	{
+	  break;
+	}
       inode->double_indirect_index++;
       new_data_sectors--;
       if (new_data_sectors == 0)
@@ -690,7 +1178,17 @@ size_t inode_expand_double_indirect_block_lvl_two (struct inode *inode,
 	  break;
 	}
     }
-  block_write(fs_device, outer_block->ptr[inode->indirect_index], &inner_block);
+  if (inode->double_indirect_index == first)
+    {
+      if (first == 0)
+	{
+	  free_map_release (outer_block->ptr[inode->indirect_index], 1);
+	}
+      return new_data_sectors;
+    }
+  inode_zero_sectors (&inner_block.ptr[first],
+		      inode->double_indirect_index - first);
+  meta_write (outer_block->ptr[inode->indirect_index], &inner_block);
   if (inode->double_indirect_index == 128)
     {
       inode->double_indirect_index = 0;
@@ -706,27 +1204,243 @@ size_t
 inode_expand_double_indirect_block (struct inode *inode, size_t new_data_sectors)
 {
       struct indirect_block block;
-      if (inode->double_indirect_index == 0 && inode->indirect_index == 0)
+      bool fresh = inode->double_indirect_index == 0
+		   && inode->indirect_index == 0;
+      size_t wanted = new_data_sectors;
+      if (fresh)
 	{
-		free_map_allocate (1, &inode->pointer[inode->direct_index]);
+		if (!inode_alloc_sector (inode, &inode->pointer[inode->direct_index]))
+		{
+		   return new_data_sectors;
+		}
 	}
        else
 	{
-		block_read (fs_device, inode->pointer[inode->direct_index],&block);
+		meta_read (inode->pointer[inode->direct_index],&block);
 	}
 	while (inode->indirect_index < 128)
 	{
- 		new_data_sectors = inode_expand_double_indirect_block_lvl_two(inode,new_data_sectors, &block);
+		size_t left = inode_expand_double_indirect_block_lvl_two(inode,new_data_sectors, &block);
+		if (left == new_data_sectors)
+		{
+		   break;
+		}
+		new_data_sectors = left;
 		if (new_data_sectors == 0)
 		{
 		   break;
 		}
 	}
-	block_write (fs_device, inode->pointer[inode->direct_index], &block);
+	if (fresh && new_data_sectors == wanted)
+	{
+		free_map_release (inode->pointer[inode->direct_index], 1);
+		return new_data_sectors;
+	}
+	meta_write (inode->pointer[inode->direct_index], &block);
 	return new_data_sectors;
 }
 
 
+/* Adds the CNT sectors starting at START to the end of INODE,
+   which uses extents, growing its last extent if they follow it.
+   Returns false if a new extent block was needed and the disk is
+   full. */
+static bool
+inode_add_extent (struct inode *inode, block_sector_t start, size_t cnt)
+{
+  struct extent_block block;
+  struct inode_extent *last;
+
+  if (inode->extent_cnt <= INODE_EXTENTS)
+    {
+      last = inode->extent_cnt > 0
+             ? &inode->extents[inode->extent_cnt - 1] : NULL;
+      if (last != NULL && last->start + last->length == start)
+        {
+          last->length += cnt;
+          inode->extent_end = start + cnt;
+          return true;
+        }
+      if (inode->extent_cnt < INODE_EXTENTS)
+        {
+          inode->extents[inode->extent_cnt].start = start;
+          inode->extents[inode->extent_cnt].length = cnt;
+          inode->extent_cnt++;
+          inode->extent_end = start + cnt;
+          return true;
+        }
+
+      /* The inode is full; start the chain of extent blocks. */
+      if (!free_map_allocate_near (inode->key.sector, 1, &inode->extent_tail))
+        return false;
+      memset (&block, 0, sizeof block);
+    }
+  else
+    {
+      meta_read (inode->extent_tail, &block);
+      last = &block.extents[block.extent_cnt - 1];
+      if (last->start + last->length == start)
+        {
+          last->length += cnt;
+          meta_write (inode->extent_tail, &block);
+          inode->extent_end = start + cnt;
+          return true;
+        }
+      if (block.extent_cnt == EXTENT_BLOCK_EXTENTS)
+        {
+          block_sector_t next;
+          if (!free_map_allocate_near (inode->key.sector, 1, &next))
+            return false;
+          block.next = next;
+          meta_write (inode->extent_tail, &block);
+          inode->extent_tail = next;
+          memset (&block, 0, sizeof block);
+        }
+    }
+
+  block.extents[block.extent_cnt].start = start;
+  block.extents[block.extent_cnt].length = cnt;
+  block.extent_cnt++;
+  meta_write (inode->extent_tail, &block);
+  if (inode->extent_head == 0)
+    inode->extent_head = inode->extent_tail;
+  inode->extent_cnt++;
+  inode->extent_end = start + cnt;
+  return true;
+}
+
+/* Grows INODE, which uses extents, to LENGTH bytes.  New sectors
+   come from inode_alloc_run(), so they usually extend the last
+   extent.  Returns the new length, which is short of LENGTH if the disk
+   filled up. */
+static off_t
+inode_expand_extents (struct inode *inode, off_t length)
+{
+  size_t have = bytes_to_sectors (inode->length);
+  size_t want = bytes_to_sectors (length);
+
+  while (have < want)
+    {
+      block_sector_t start;
+      size_t cnt = inode_alloc_run (inode, want - have, &start);
+
+      if (cnt == 0)
+        return (off_t) have * BLOCK_SECTOR_SIZE;
+      cache_zero (start, cnt);
+      if (!inode_add_extent (inode, start, cnt))
+        {
+          free_map_release (start, cnt);
+          return (off_t) have * BLOCK_SECTOR_SIZE;
+        }
+      have += cnt;
+    }
+  return length;
+}
+
+/* Releases the data and extent blocks of INODE, which uses
+   extents. */
+static void
+inode_dealloc_extents (struct inode *inode)
+{
+  struct extent_block block;
+  block_sector_t next;
+  size_t i;
+
+  for (i = 0; i < inode->extent_cnt && i < INODE_EXTENTS; i++)
+    free_map_release (inode->extents[i].start, inode->extents[i].length);
+  for (next = inode->extent_head; next != 0; next = block.next)
+    {
+      meta_read (next, &block);
+      for (i = 0; i < block.extent_cnt; i++)
+        free_map_release (block.extents[i].start, block.extents[i].length);
+      free_map_release (next, 1);
+    }
+}
+
+/* Returns where the next block of INODE should go: right after its
+   last block, or after INODE itself if it has none yet. */
+static block_sector_t
+inode_alloc_goal (struct inode *inode)
+{
+  if (inode->format == INODE_EXTENT && inode->extent_cnt > 0)
+    return inode->extent_end;
+  if (inode->format == INODE_INDEXED && inode->length > 0)
+    return byte_to_sector (inode, inode->length, inode->length - 1) + 1;
+  return inode->key.sector + 1;
+}
+
+/* Hands out up to WANT sectors for INODE to grow by, as a run whose
+   first sector is stored in *START, and returns its length, or 0 if
+   the disk is full.
+
+   The sectors come from INODE's preallocation window.  When that is
+   used up, a new window of at least PREALLOC_WINDOW sectors is
+   reserved as close after INODE's last block as possible, so a file
+   that grows a little at a time keeps getting consecutive sectors
+   even while other files grow too.  Whatever is left of the window
+   is given back when INODE is closed for the last time. */
+static size_t
+inode_alloc_run (struct inode *inode, size_t want, block_sector_t *start)
+{
+  size_t cnt;
+
+  if (inode->prealloc_cnt == 0)
+    {
+      size_t window = want > PREALLOC_WINDOW ? want : PREALLOC_WINDOW;
+
+      if (inode->alloc_goal == 0)
+        inode->alloc_goal = inode_alloc_goal (inode);
+      while (!free_map_allocate_near (inode->alloc_goal, window,
+                                      &inode->prealloc_start))
+        if ((window /= 2) == 0)
+          return 0;
+      inode->prealloc_cnt = window;
+    }
+  cnt = want < inode->prealloc_cnt ? want : inode->prealloc_cnt;
+  *start = inode->prealloc_start;
+  inode->prealloc_start += cnt;
+  inode->prealloc_cnt -= cnt;
+  inode->alloc_goal = inode->prealloc_start;
+  return cnt;
+}
+
+/* Allocates one sector for INODE with inode_alloc_run() and stores
+   it in *SECTORP.  Returns false if the disk is full. */
+static bool
+inode_alloc_sector (struct inode *inode, block_sector_t *sectorp)
+{
+  return inode_alloc_run (inode, 1, sectorp) == 1;
+}
+
+/* Gives back the unused part of INODE's preallocation window. */
+static void
+inode_prealloc_release (struct inode *inode)
+{
+  if (inode->prealloc_cnt > 0)
+    free_map_release (inode->prealloc_start, inode->prealloc_cnt);
+  inode->prealloc_cnt = 0;
+}
+
+/* Returns the number of runs of consecutive sectors that hold the
+   data of INODE: 1 for a perfectly contiguous file. */
+size_t
+inode_fragment_count (struct inode *inode)
+{
+  off_t length = inode_length (inode);
+  block_sector_t prev = 0;
+  size_t runs = 0;
+  off_t pos;
+
+  for (pos = 0; pos < length; pos += BLOCK_SECTOR_SIZE)
+    {
+      block_sector_t sector = byte_to_sector (inode, length, pos);
+      if (pos == 0 || sector != prev + 1)
+        runs++;
+      prev = sector;
+    }
+  return runs;
+}
+
 bool
 inode_is_dir (const struct inode *inode)
 {
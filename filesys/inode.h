@@ -8,6 +8,8 @@
 struct bitmap;
 
 void inode_init (void);
+bool inode_set_format (const char *name);
+void inode_use_format_of (block_sector_t);
 bool inode_create (block_sector_t, off_t, bool);
 struct inode *inode_open (block_sector_t);
 struct inode *inode_reopen (struct inode *);
@@ -19,6 +21,7 @@ off_t inode_write_at (struct inode *, const void *, off_t size, off_t offset);
 void inode_deny_write (struct inode *);
 void inode_allow_write (struct inode *);
 off_t inode_length (const struct inode *);
+size_t inode_fragment_count (struct inode *);
 
 bool
 inode_is_dir (const struct inode *inode);
@@ -3,6 +3,7 @@
 #include <limits.h>
 #include <round.h>
 #include <stdio.h>
+#include "threads/interrupt.h"
 #include "threads/malloc.h"
 #ifdef FILESYS
 #include "filesys/file.h"
@@ -21,13 +22,23 @@ typedef unsigned long elem_type;
 /* Number of bits in an element. */
 #define ELEM_BITS (sizeof (elem_type) * CHAR_BIT)
 
+/* Bitmaps with at least this many bits get a summary layer. */
+#define SUMMARY_MIN_BITS (ELEM_BITS * ELEM_BITS * 16)
+
 /* From the outside, a bitmap is an array of bits.  From the
    inside, it's an array of elem_type (defined above) that
-   simulates an array of bits. */
+   simulates an array of bits.
+
+   A large bitmap also has a summary, with one bit per element of
+   BITS that is set if every bit in that element is.  Scans for
+   false bits use it to skip ELEM_BITS full elements at a time.
+   An element and its summary bit are changed together with
+   interrupts off, so the single-bit operations stay atomic. */
 struct bitmap
   {
     size_t bit_cnt;     /* Number of bits. */
     elem_type *bits;    /* Elements that represent bits. */
+    elem_type *full;    /* Summary of BITS, or a null pointer. */
   };
 
 /* Returns the index of the element that contains the bit
@@ -69,6 +80,65 @@ last_mask (const struct bitmap *b)
   return last_bits ? ((elem_type) 1 << last_bits) - 1 : (elem_type) -1;
 }
 
+/* Returns the index of the lowest set bit in WORD, which must not
+   be zero. */
+static inline size_t
+lowest_bit (elem_type word)
+{
+  return __builtin_ctzl (word);
+}
+
+/* Returns true if every bit of element ELEM of B is set. */
+static inline bool
+elem_full (const struct bitmap *b, size_t elem)
+{
+  elem_type mask = elem == elem_cnt (b->bit_cnt) - 1 ? last_mask (b)
+                                                     : (elem_type) -1;
+  return (b->bits[elem] & mask) == mask;
+}
+
+/* Brings the summary bit of element ELEM of B up to date. */
+static inline void
+summary_update (struct bitmap *b, size_t elem)
+{
+  if (b->full != NULL)
+    {
+      if (elem_full (b, elem))
+        b->full[elem_idx (elem)] |= bit_mask (elem);
+      else
+        b->full[elem_idx (elem)] &= ~bit_mask (elem);
+    }
+}
+
+/* Starts a change to B that must stay atomic with the summary
+   update that follows it.  Returns the interrupt level to pass to
+   summary_end(). */
+static inline enum intr_level
+summary_begin (const struct bitmap *b)
+{
+  return b->full != NULL ? intr_disable () : INTR_OFF;
+}
+
+/* Ends a change started with summary_begin(), which returned
+   OLD_LEVEL. */
+static inline void
+summary_end (const struct bitmap *b, enum intr_level old_level)
+{
+  if (b->full != NULL)
+    intr_set_level (old_level);
+}
+
+/* Rebuilds the whole summary of B. */
+static void
+summary_rebuild (struct bitmap *b)
+{
+  size_t i;
+
+  if (b->full != NULL)
+    for (i = 0; i < elem_cnt (b->bit_cnt); i++)
+      summary_update (b, i);
+}
+
 /* Creation and destruction. */
 
 /* Creates and returns a pointer to a newly allocated bitmap with room for
@@ -83,8 +153,14 @@ bitmap_create (size_t bit_cnt)
     {
       b->bit_cnt = bit_cnt;
       b->bits = malloc (byte_cnt (bit_cnt));
+      b->full = NULL;
       if (b->bits != NULL || bit_cnt == 0)
         {
+          /* The summary is only an accelerator; do without it if
+             there is no memory for it. */
+          if (bit_cnt >= SUMMARY_MIN_BITS)
+            b->full = calloc (elem_cnt (elem_cnt (bit_cnt)),
+                              sizeof (elem_type));
           bitmap_set_all (b, false);
           return b;
         }
@@ -105,6 +181,7 @@ bitmap_create_in_buf (size_t bit_cnt, void *block, size_t block_size UNUSED)
 
   b->bit_cnt = bit_cnt;
   b->bits = (elem_type *) (b + 1);
+  b->full = NULL;
   bitmap_set_all (b, false);
   return b;
 }
@@ -124,6 +201,7 @@ bitmap_destroy (struct bitmap *b)
 {
   if (b != NULL) 
     {
+      free (b->full);
       free (b->bits);
       free (b);
     }
@@ -158,11 +236,15 @@ bitmap_mark (struct bitmap *b, size_t bit_idx)
 {
   size_t idx = elem_idx (bit_idx);
   elem_type mask = bit_mask (bit_idx);
+  enum intr_level old_level;
 
   /* This is equivalent to `b->bits[idx] |= mask' except that it
      is guaranteed to be atomic on a uniprocessor machine.  See
      the description of the OR instruction in [IA32-v2b]. */
+  old_level = summary_begin (b);
   asm ("orl %1, %0" : "=m" (b->bits[idx]) : "r" (mask) : "cc");
+  summary_update (b, idx);
+  summary_end (b, old_level);
 }
 
 /* Atomically sets the bit numbered BIT_IDX in B to false. */
@@ -171,11 +253,15 @@ bitmap_reset (struct bitmap *b, size_t bit_idx)
 {
   size_t idx = elem_idx (bit_idx);
   elem_type mask = bit_mask (bit_idx);
+  enum intr_level old_level;
 
   /* This is equivalent to `b->bits[idx] &= ~mask' except that it
      is guaranteed to be atomic on a uniprocessor machine.  See
      the description of the AND instruction in [IA32-v2a]. */
+  old_level = summary_begin (b);
   asm ("andl %1, %0" : "=m" (b->bits[idx]) : "r" (~mask) : "cc");
+  summary_update (b, idx);
+  summary_end (b, old_level);
 }
 
 /* Atomically toggles the bit numbered IDX in B;
@@ -186,11 +272,15 @@ bitmap_flip (struct bitmap *b, size_t bit_idx)
 {
   size_t idx = elem_idx (bit_idx);
   elem_type mask = bit_mask (bit_idx);
+  enum intr_level old_level;
 
   /* This is equivalent to `b->bits[idx] ^= mask' except that it
      is guaranteed to be atomic on a uniprocessor machine.  See
      the description of the XOR instruction in [IA32-v2b]. */
+  old_level = summary_begin (b);
   asm ("xorl %1, %0" : "=m" (b->bits[idx]) : "r" (mask) : "cc");
+  summary_update (b, idx);
+  summary_end (b, old_level);
 }
 
 /* Returns the value of the bit numbered IDX in B. */
@@ -213,18 +303,36 @@ bitmap_set_all (struct bitmap *b, bool value)
   bitmap_set_multiple (b, 0, bitmap_size (b), value);
 }
 
-/* Sets the CNT bits starting at START in B to VALUE. */
+/* Sets the CNT bits starting at START in B to VALUE.
+   Works a whole element at a time. */
 void
 bitmap_set_multiple (struct bitmap *b, size_t start, size_t cnt, bool value) 
 {
-  size_t i;
+  size_t end = start + cnt;
   
   ASSERT (b != NULL);
   ASSERT (start <= b->bit_cnt);
   ASSERT (start + cnt <= b->bit_cnt);
 
-  for (i = 0; i < cnt; i++)
-    bitmap_set (b, start + i, value);
+  while (start < end)
+    {
+      size_t idx = elem_idx (start);
+      size_t ofs = start % ELEM_BITS;
+      size_t n = end - start < ELEM_BITS - ofs ? end - start : ELEM_BITS - ofs;
+      elem_type mask = n == ELEM_BITS ? (elem_type) -1
+                                      : (((elem_type) 1 << n) - 1) << ofs;
+      enum intr_level old_level;
+
+      /* Same as in bitmap_mark() and bitmap_reset(). */
+      old_level = summary_begin (b);
+      if (value)
+        asm ("orl %1, %0" : "=m" (b->bits[idx]) : "r" (mask) : "cc");
+      else
+        asm ("andl %1, %0" : "=m" (b->bits[idx]) : "r" (~mask) : "cc");
+      summary_update (b, idx);
+      summary_end (b, old_level);
+      start += n;
+    }
 }
 
 /* Returns the number of bits in B between START and START + CNT,
@@ -245,21 +353,67 @@ bitmap_count (const struct bitmap *b, size_t start, size_t cnt, bool value)
   return value_cnt;
 }
 
+/* Returns the index of the first element at or after ELEM of B
+   that has a false bit, according to B's summary, or the number of
+   elements if there is none. */
+static size_t
+next_nonfull_elem (const struct bitmap *b, size_t elem)
+{
+  size_t elems = elem_cnt (b->bit_cnt);
+  size_t i = elem_idx (elem);
+  elem_type word;
+
+  if (elem >= elems)
+    return elems;
+  word = ~b->full[i] & ~(bit_mask (elem) - 1);
+  while (word == 0)
+    {
+      if (++i >= elem_cnt (elems))
+        return elems;
+      word = ~b->full[i];
+    }
+  elem = i * ELEM_BITS + lowest_bit (word);
+  return elem < elems ? elem : elems;
+}
+
+/* Returns the index of the first bit in B between START and LIMIT,
+   exclusive, that is set to VALUE, or LIMIT if there is none.
+   Looks at a whole element at a time, and when looking for false
+   bits skips the elements B's summary marks full. */
+static size_t
+find_bit (const struct bitmap *b, size_t start, size_t limit, bool value)
+{
+  elem_type flip = value ? 0 : (elem_type) -1;
+  size_t elem = elem_idx (start);
+  elem_type word;
+  size_t idx;
+
+  if (start >= limit)
+    return limit;
+  word = (b->bits[elem] ^ flip) & ~(bit_mask (start) - 1);
+  while (word == 0)
+    {
+      elem++;
+      if (!value && b->full != NULL)
+        elem = next_nonfull_elem (b, elem);
+      if (elem * ELEM_BITS >= limit)
+        return limit;
+      word = b->bits[elem] ^ flip;
+    }
+  idx = elem * ELEM_BITS + lowest_bit (word);
+  return idx < limit ? idx : limit;
+}
+
 /* Returns true if any bits in B between START and START + CNT,
    exclusive, are set to VALUE, and false otherwise. */
 bool
 bitmap_contains (const struct bitmap *b, size_t start, size_t cnt, bool value) 
 {
-  size_t i;
-  
   ASSERT (b != NULL);
   ASSERT (start <= b->bit_cnt);
   ASSERT (start + cnt <= b->bit_cnt);
 
-  for (i = 0; i < cnt; i++)
-    if (bitmap_test (b, start + i) == value)
-      return true;
-  return false;
+  return find_bit (b, start, start + cnt, value) < start + cnt;
 }
 
 /* Returns true if any bits in B between START and START + CNT,
@@ -291,7 +445,12 @@ bitmap_all (const struct bitmap *b, size_t start, size_t cnt)
 /* Finds and returns the starting index of the first group of CNT
    consecutive bits in B at or after START that are all set to
    VALUE.
-   If there is no such group, returns BITMAP_ERROR. */
+   If there is no such group, returns BITMAP_ERROR.
+
+   Jumps from one bit set to VALUE to the next, then checks up to
+   CNT bits past it for one that is not, a whole element at a time.
+   A group that is too short is skipped entirely, so every bit is
+   looked at about once. */
 size_t
 bitmap_scan (const struct bitmap *b, size_t start, size_t cnt, bool value) 
 {
@@ -301,10 +460,21 @@ bitmap_scan (const struct bitmap *b, size_t start, size_t cnt, bool value)
   if (cnt <= b->bit_cnt) 
     {
       size_t last = b->bit_cnt - cnt;
-      size_t i;
-      for (i = start; i <= last; i++)
-        if (!bitmap_contains (b, i, cnt, !value))
-          return i; 
+      size_t i = start;
+      if (cnt == 0)
+        return start;
+      while (i <= last)
+        {
+          size_t end;
+
+          i = find_bit (b, i, last + 1, value);
+          if (i > last)
+            break;
+          end = find_bit (b, i, i + cnt, !value);
+          if (end == i + cnt)
+            return i;
+          i = end;
+        }
     }
   return BITMAP_ERROR;
 }
@@ -346,6 +516,7 @@ bitmap_read (struct bitmap *b, struct file *file)
       off_t size = byte_cnt (b->bit_cnt);
       success = file_read_at (file, b->bits, size, 0) == size;
       b->bits[elem_cnt (b->bit_cnt) - 1] &= last_mask (b);
+      summary_rebuild (b);
     }
   return success;
 }
@@ -358,6 +529,29 @@ bitmap_write (const struct bitmap *b, struct file *file)
   off_t size = byte_cnt (b->bit_cnt);
   return file_write_at (file, b->bits, size, 0) == size;
 }
+
+/* Writes the part of B that holds the CNT bits starting at START
+   to the same place in FILE, as written by bitmap_write().
+   Returns true if successful, false otherwise. */
+bool
+bitmap_write_range (const struct bitmap *b, struct file *file,
+                    size_t start, size_t cnt)
+{
+  size_t first, last;
+  off_t size;
+
+  ASSERT (b != NULL);
+  ASSERT (start <= b->bit_cnt);
+  ASSERT (start + cnt <= b->bit_cnt);
+
+  if (cnt == 0)
+    return true;
+  first = elem_idx (start);
+  last = elem_idx (start + cnt - 1);
+  size = (last - first + 1) * sizeof (elem_type);
+  return (file_write_at (file, b->bits + first, size,
+                         first * sizeof (elem_type)) == size);
+}
 #endif /* FILESYS */
 
 /* Debugging. */
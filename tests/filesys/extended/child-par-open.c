@@ -0,0 +1,67 @@
+/* Child process for par-open.
+   Opens every file our parent created, checking each one's
+   contents, keeps them all open and then closes them, ROUND_CNT
+   times.  Each child starts at a different file so that the
+   children open and close the same inodes out of step.  In every
+   round it also creates its own file, opens it twice, removes it,
+   and checks that the open descriptors still work. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <syscall.h>
+#include "tests/filesys/extended/par-open.h"
+#include "tests/lib.h"
+
+const char *test_name = "child-par-open";
+
+static int fds[FILE_CNT];
+
+int
+main (int argc, const char *argv[]) 
+{
+  char file_name[16], tmp_name[16], buf[16];
+  int child_idx;
+  int round, i;
+
+  quiet = true;
+  
+  CHECK (argc == 2, "argc must be 2, actually %d", argc);
+  child_idx = atoi (argv[1]);
+  snprintf (tmp_name, sizeof tmp_name, "tmp%d", child_idx);
+
+  for (round = 0; round < ROUND_CNT; round++)
+    {
+      int fd1, fd2;
+
+      for (i = 0; i < FILE_CNT; i++)
+        {
+          int idx = (i + child_idx * FILE_CNT / CHILD_CNT) % FILE_CNT;
+          size_t size;
+
+          snprintf (file_name, sizeof file_name, "file%d", idx);
+          size = strlen (file_name);
+          CHECK ((fds[idx] = open (file_name)) > 1, "open \"%s\"", file_name);
+          CHECK (read (fds[idx], buf, size) == (int) size,
+                 "read \"%s\"", file_name);
+          compare_bytes (buf, file_name, size, 0, file_name);
+        }
+      for (i = 0; i < FILE_CNT; i++)
+        close (fds[i]);
+
+      CHECK (create (tmp_name, 0), "create \"%s\"", tmp_name);
+      CHECK ((fd1 = open (tmp_name)) > 1, "open \"%s\"", tmp_name);
+      CHECK ((fd2 = open (tmp_name)) > 1, "open \"%s\" again", tmp_name);
+      CHECK (remove (tmp_name), "remove \"%s\"", tmp_name);
+      CHECK (open (tmp_name) == -1, "open \"%s\" after remove", tmp_name);
+      CHECK (write (fd1, tmp_name, sizeof tmp_name) == sizeof tmp_name,
+             "write \"%s\"", tmp_name);
+      CHECK (read (fd2, buf, sizeof buf) == sizeof buf,
+             "read \"%s\"", tmp_name);
+      compare_bytes (buf, tmp_name, sizeof buf, 0, tmp_name);
+      close (fd1);
+      close (fd2);
+    }
+
+  return child_idx;
+}
@@ -0,0 +1,46 @@
+/* Child process for par-read.
+   Reads the file written for it by our parent process from start
+   to end READ_CNT times, checking the contents each time. */
+
+#include <random.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <syscall.h>
+#include "tests/filesys/extended/par-read.h"
+#include "tests/lib.h"
+
+const char *test_name = "child-par-read";
+
+static char buf1[FILE_SIZE * CHILD_CNT];
+static char buf2[FILE_SIZE];
+
+int
+main (int argc, const char *argv[]) 
+{
+  char file_name[16];
+  int child_idx;
+  int fd;
+  int i;
+
+  quiet = true;
+  
+  CHECK (argc == 2, "argc must be 2, actually %d", argc);
+  child_idx = atoi (argv[1]);
+  snprintf (file_name, sizeof file_name, "data%d", child_idx);
+
+  random_init (0);
+  random_bytes (buf1, sizeof buf1);
+
+  CHECK ((fd = open (file_name)) > 1, "open \"%s\"", file_name);
+  for (i = 0; i < READ_CNT; i++)
+    {
+      seek (fd, 0);
+      CHECK (read (fd, buf2, FILE_SIZE) == FILE_SIZE,
+             "read \"%s\"", file_name);
+      compare_bytes (buf2, buf1 + child_idx * FILE_SIZE, FILE_SIZE, 0,
+                     file_name);
+    }
+  close (fd);
+
+  return child_idx;
+}
@@ -0,0 +1,73 @@
+/* Creates a directory, then creates 1,500 empty files in it,
+   enough to give an indexed directory more than one level of
+   index.  Checks that each file can be opened and that readdir
+   lists each one exactly once, then removes them all. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define FILE_CNT 1500
+
+static char seen[FILE_CNT];
+
+void
+test_main (void) 
+{
+  char name[READDIR_MAX_LEN + 1];
+  char file_name[32];
+  int fd, cnt, i;
+
+  CHECK (mkdir ("/x"), "mkdir \"/x\"");
+
+  msg ("creating %d files in \"/x\"", FILE_CNT);
+  for (i = 0; i < FILE_CNT; i++)
+    {
+      snprintf (file_name, sizeof file_name, "/x/file%d", i);
+      if (!create (file_name, 0))
+        fail ("create \"%s\" failed", file_name);
+    }
+
+  msg ("opening %d files in \"/x\"", FILE_CNT);
+  for (i = 0; i < FILE_CNT; i++)
+    {
+      snprintf (file_name, sizeof file_name, "/x/file%d", i);
+      fd = open (file_name);
+      if (fd < 2)
+        fail ("open \"%s\" failed", file_name);
+      close (fd);
+    }
+  CHECK (open ("/x/file-missing") == -1,
+         "open \"/x/file-missing\" (must return -1)");
+
+  CHECK ((fd = open ("/x")) > 1, "open \"/x\"");
+  msg ("reading \"/x\"");
+  cnt = 0;
+  while (readdir (fd, name))
+    {
+      if (memcmp (name, "file", 4) || (i = atoi (name + 4)) < 0
+          || i >= FILE_CNT)
+        fail ("readdir returned unexpected \"%s\"", name);
+      if (seen[i])
+        fail ("readdir returned \"%s\" twice", name);
+      seen[i] = 1;
+      cnt++;
+    }
+  if (cnt != FILE_CNT)
+    fail ("readdir returned %d names, expected %d", cnt, FILE_CNT);
+  close (fd);
+
+  msg ("removing %d files in \"/x\"", FILE_CNT);
+  for (i = 0; i < FILE_CNT; i++)
+    {
+      snprintf (file_name, sizeof file_name, "/x/file%d", i);
+      if (!remove (file_name))
+        fail ("remove \"%s\" failed", file_name);
+    }
+  CHECK ((fd = open ("/x")) > 1, "open \"/x\"");
+  CHECK (!readdir (fd, name), "verify \"/x\" is empty");
+  close (fd);
+}
@@ -0,0 +1,18 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(grow-dir-idx) begin
+(grow-dir-idx) mkdir "/x"
+(grow-dir-idx) creating 1500 files in "/x"
+(grow-dir-idx) opening 1500 files in "/x"
+(grow-dir-idx) open "/x/file-missing" (must return -1)
+(grow-dir-idx) open "/x"
+(grow-dir-idx) reading "/x"
+(grow-dir-idx) removing 1500 files in "/x"
+(grow-dir-idx) open "/x"
+(grow-dir-idx) verify "/x" is empty
+(grow-dir-idx) end
+EOF
+pass;
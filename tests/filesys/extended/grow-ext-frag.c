@@ -0,0 +1,55 @@
+/* Grows two files alternately, one sector at a time, on a file
+   system formatted with extents.  Neither file ever gets two
+   consecutive sectors, so each needs more extents than fit in its
+   inode and spills into a chain of extent blocks. */
+
+#include <random.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define FILE_SIZE (128 * 512)
+static char buf_a[FILE_SIZE];
+static char buf_b[FILE_SIZE];
+
+static void
+write_sector (const char *file_name, int fd, const char *buf, size_t ofs)
+{
+  int ret_val = write (fd, buf + ofs, 512);
+  if (ret_val != 512)
+    fail ("write 512 bytes at offset %zu in \"%s\" returned %d",
+          ofs, file_name, ret_val);
+}
+
+void
+test_main (void)
+{
+  int fd_a, fd_b;
+  size_t ofs;
+
+  random_init (0);
+  random_bytes (buf_a, sizeof buf_a);
+  random_bytes (buf_b, sizeof buf_b);
+
+  CHECK (create ("a", 0), "create \"a\"");
+  CHECK (create ("b", 0), "create \"b\"");
+
+  CHECK ((fd_a = open ("a")) > 1, "open \"a\"");
+  CHECK ((fd_b = open ("b")) > 1, "open \"b\"");
+
+  msg ("write \"a\" and \"b\" a sector at a time");
+  for (ofs = 0; ofs < FILE_SIZE; ofs += 512)
+    {
+      write_sector ("a", fd_a, buf_a, ofs);
+      write_sector ("b", fd_b, buf_b, ofs);
+    }
+
+  msg ("close \"a\"");
+  close (fd_a);
+
+  msg ("close \"b\"");
+  close (fd_b);
+
+  check_file ("a", buf_a, FILE_SIZE);
+  check_file ("b", buf_b, FILE_SIZE);
+}
@@ -0,0 +1,23 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+use tests::random;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(grow-ext-frag) begin
+(grow-ext-frag) create "a"
+(grow-ext-frag) create "b"
+(grow-ext-frag) open "a"
+(grow-ext-frag) open "b"
+(grow-ext-frag) write "a" and "b" a sector at a time
+(grow-ext-frag) close "a"
+(grow-ext-frag) close "b"
+(grow-ext-frag) open "a" for verification
+(grow-ext-frag) verified contents of "a"
+(grow-ext-frag) close "a"
+(grow-ext-frag) open "b" for verification
+(grow-ext-frag) verified contents of "b"
+(grow-ext-frag) close "b"
+(grow-ext-frag) end
+EOF
+pass;
@@ -0,0 +1,17 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+use tests::random;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(grow-ext-seq-lg) begin
+(grow-ext-seq-lg) create "testme"
+(grow-ext-seq-lg) open "testme"
+(grow-ext-seq-lg) writing "testme"
+(grow-ext-seq-lg) close "testme"
+(grow-ext-seq-lg) open "testme" for verification
+(grow-ext-seq-lg) verified contents of "testme"
+(grow-ext-seq-lg) close "testme"
+(grow-ext-seq-lg) end
+EOF
+pass;
@@ -0,0 +1,4 @@
+/* Runs grow-sparse on a file system formatted with extents, where
+   the whole zeroed region is allocated as one extent. */
+
+#include "tests/filesys/extended/grow-sparse.c"
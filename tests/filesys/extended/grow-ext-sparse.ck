@@ -0,0 +1,17 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(grow-ext-sparse) begin
+(grow-ext-sparse) create "testfile"
+(grow-ext-sparse) open "testfile"
+(grow-ext-sparse) seek "testfile"
+(grow-ext-sparse) write "testfile"
+(grow-ext-sparse) close "testfile"
+(grow-ext-sparse) open "testfile" for verification
+(grow-ext-sparse) verified contents of "testfile"
+(grow-ext-sparse) close "testfile"
+(grow-ext-sparse) end
+EOF
+pass;
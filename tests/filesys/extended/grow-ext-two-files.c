@@ -0,0 +1,4 @@
+/* Runs grow-two-files on a file system formatted with extents,
+   where the two files' extents interleave. */
+
+#include "tests/filesys/extended/grow-two-files.c"
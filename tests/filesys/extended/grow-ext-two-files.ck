@@ -0,0 +1,23 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+use tests::random;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(grow-ext-two-files) begin
+(grow-ext-two-files) create "a"
+(grow-ext-two-files) create "b"
+(grow-ext-two-files) open "a"
+(grow-ext-two-files) open "b"
+(grow-ext-two-files) write "a" and "b" alternately
+(grow-ext-two-files) close "a"
+(grow-ext-two-files) close "b"
+(grow-ext-two-files) open "a" for verification
+(grow-ext-two-files) verified contents of "a"
+(grow-ext-two-files) close "a"
+(grow-ext-two-files) open "b" for verification
+(grow-ext-two-files) verified contents of "b"
+(grow-ext-two-files) close "b"
+(grow-ext-two-files) end
+EOF
+pass;
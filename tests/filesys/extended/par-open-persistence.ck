@@ -0,0 +1,7 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_archive ({"child-par-open" => "tests/filesys/extended/child-par-open",
+		map (("file$_" => ["file$_"]), 0..99)});
+pass;
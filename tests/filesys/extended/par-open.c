@@ -0,0 +1,56 @@
+/* Several processes open and close the same hundred files over
+   and over at the same time, thousands of opens in all, while
+   each also creates and removes a file of its own that it keeps
+   open across the removal.  Every open of a file that is already
+   open elsewhere must find the same inode, and the last close of
+   each must leave it intact on disk. */
+
+#include <stdio.h>
+#include <string.h>
+#include <syscall.h>
+#include "tests/filesys/extended/par-open.h"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void) 
+{
+  pid_t children[CHILD_CNT];
+  char file_name[16];
+  int fd, i;
+
+  msg ("creating %d files", FILE_CNT);
+  for (i = 0; i < FILE_CNT; i++)
+    {
+      size_t size;
+
+      snprintf (file_name, sizeof file_name, "file%d", i);
+      size = strlen (file_name);
+      if (!create (file_name, 0))
+        fail ("create \"%s\" failed", file_name);
+      if ((fd = open (file_name)) < 2)
+        fail ("open \"%s\" failed", file_name);
+      if (write (fd, file_name, size) != (int) size)
+        fail ("write \"%s\" failed", file_name);
+      close (fd);
+    }
+
+  exec_children ("child-par-open", children, CHILD_CNT);
+  wait_children (children, CHILD_CNT);
+
+  msg ("checking %d files", FILE_CNT);
+  for (i = 0; i < FILE_CNT; i++)
+    {
+      char buf[16];
+      size_t size;
+
+      snprintf (file_name, sizeof file_name, "file%d", i);
+      size = strlen (file_name);
+      if ((fd = open (file_name)) < 2)
+        fail ("open \"%s\" failed", file_name);
+      if (filesize (fd) != (int) size || read (fd, buf, size) != (int) size
+          || memcmp (buf, file_name, size))
+        fail ("\"%s\" has wrong contents", file_name);
+      close (fd);
+    }
+}
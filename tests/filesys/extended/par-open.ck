@@ -0,0 +1,19 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(par-open) begin
+(par-open) creating 100 files
+(par-open) exec child 1 of 4: "child-par-open 0"
+(par-open) exec child 2 of 4: "child-par-open 1"
+(par-open) exec child 3 of 4: "child-par-open 2"
+(par-open) exec child 4 of 4: "child-par-open 3"
+(par-open) wait for child 1 of 4 returned 0 (expected 0)
+(par-open) wait for child 2 of 4 returned 1 (expected 1)
+(par-open) wait for child 3 of 4 returned 2 (expected 2)
+(par-open) wait for child 4 of 4 returned 3 (expected 3)
+(par-open) checking 100 files
+(par-open) end
+EOF
+pass;
@@ -0,0 +1,8 @@
+#ifndef TESTS_FILESYS_EXTENDED_PAR_OPEN_H
+#define TESTS_FILESYS_EXTENDED_PAR_OPEN_H
+
+#define CHILD_CNT 4
+#define FILE_CNT 100
+#define ROUND_CNT 10
+
+#endif /* tests/filesys/extended/par-open.h */
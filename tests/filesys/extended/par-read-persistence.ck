@@ -0,0 +1,10 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+use tests::random;
+my ($data) = random_bytes (32 * 1024 * 4);
+check_archive ({"child-par-read" => "tests/filesys/extended/child-par-read",
+		map (("data$_" => [substr ($data, $_ * 32 * 1024, 32 * 1024)]),
+		     0..3)});
+pass;
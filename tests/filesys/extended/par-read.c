@@ -0,0 +1,41 @@
+/* Several processes repeatedly read their own file at the same
+   time.  The files together are bigger than the buffer cache, so
+   the readers keep missing in different parts of the cache while
+   the others hit; with a sharded cache they should not have to
+   wait on each other's disk transfers. */
+
+#include <random.h>
+#include <stdio.h>
+#include <syscall.h>
+#include "tests/filesys/extended/par-read.h"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+static char buf[FILE_SIZE * CHILD_CNT];
+
+void
+test_main (void) 
+{
+  pid_t children[CHILD_CNT];
+  size_t i;
+
+  random_init (0);
+  random_bytes (buf, sizeof buf);
+
+  for (i = 0; i < CHILD_CNT; i++)
+    {
+      char file_name[16];
+      int fd;
+
+      snprintf (file_name, sizeof file_name, "data%zu", i);
+      CHECK (create (file_name, 0), "create \"%s\"", file_name);
+      CHECK ((fd = open (file_name)) > 1, "open \"%s\"", file_name);
+      CHECK (write (fd, buf + i * FILE_SIZE, FILE_SIZE) == FILE_SIZE,
+             "write \"%s\"", file_name);
+      msg ("close \"%s\"", file_name);
+      close (fd);
+    }
+
+  exec_children ("child-par-read", children, CHILD_CNT);
+  wait_children (children, CHILD_CNT);
+}
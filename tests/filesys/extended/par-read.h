@@ -0,0 +1,8 @@
+#ifndef TESTS_FILESYS_EXTENDED_PAR_READ_H
+#define TESTS_FILESYS_EXTENDED_PAR_READ_H
+
+#define CHILD_CNT 4
+#define FILE_SIZE (32 * 1024)
+#define READ_CNT 8
+
+#endif /* tests/filesys/extended/par-read.h */
@@ -0,0 +1,107 @@
+/* Fragmentation and throughput benchmark for the sector allocator
+   in filesys/free-map.c and filesys/inode.c.
+
+   Grows two files in parallel, as grow-two-files does, with writes
+   of random size up to 1 kB alternating between them until each is
+   256 kB.  Prints how long that took and into how many runs of
+   consecutive sectors each file's data ended up, then times reading
+   both files back.  With goal-directed allocation and preallocation
+   windows each file should come out in a handful of runs, rather
+   than one run per write.
+
+   Run with "pintos -- -q bench alloc" on a formatted file system
+   disk with at least 1 MB free. */
+
+#undef NDEBUG
+#include <debug.h>
+#include <inttypes.h>
+#include <random.h>
+#include <stdio.h>
+#include "devices/timer.h"
+#include "filesys/file.h"
+#include "filesys/filesys.h"
+#include "filesys/inode.h"
+#include "tests/internal/bench.h"
+#include "threads/malloc.h"
+
+/* Final size of each file. */
+#define FILE_SIZE (256 * 1024)
+
+/* Largest single write. */
+#define MAX_WRITE 1024
+
+static void write_some_bytes (struct file *, const char *buf, size_t *ofs);
+static int64_t read_back (struct file *, char *buf);
+
+/* Grows two files alternately and reports their fragmentation. */
+void
+bench_alloc (void)
+{
+  static const char *names[2] = {"alloc-a", "alloc-b"};
+  struct file *files[2];
+  size_t ofs[2] = {0, 0};
+  int64_t start, ticks;
+  char *buf;
+  int i;
+
+  buf = malloc (MAX_WRITE);
+  ASSERT (buf != NULL);
+  random_init (0);
+  random_bytes (buf, MAX_WRITE);
+
+  for (i = 0; i < 2; i++)
+    {
+      ASSERT (filesys_create (names[i], 0, false));
+      files[i] = filesys_open (names[i]);
+      ASSERT (files[i] != NULL);
+    }
+
+  start = timer_ticks ();
+  while (ofs[0] < FILE_SIZE || ofs[1] < FILE_SIZE)
+    for (i = 0; i < 2; i++)
+      write_some_bytes (files[i], buf, &ofs[i]);
+  ticks = timer_elapsed (start);
+  printf ("alloc: wrote 2 x %d bytes in %"PRId64" ticks\n", FILE_SIZE, ticks);
+
+  for (i = 0; i < 2; i++)
+    {
+      printf ("alloc: %s: %zu runs of %d sectors\n", names[i],
+              inode_fragment_count (file_get_inode (files[i])),
+              FILE_SIZE / 512);
+      printf ("alloc: %s: read back in %"PRId64" ticks\n", names[i],
+              read_back (files[i], buf));
+      file_close (files[i]);
+      ASSERT (filesys_remove (names[i]));
+    }
+
+  free (buf);
+  printf ("alloc: PASS\n");
+}
+
+/* Appends between 1 and MAX_WRITE bytes from BUF to FILE, which
+   holds *OFS bytes so far, unless it is complete. */
+static void
+write_some_bytes (struct file *file, const char *buf, size_t *ofs)
+{
+  size_t size = random_ulong () % MAX_WRITE + 1;
+
+  if (*ofs >= FILE_SIZE)
+    return;
+  if (size > FILE_SIZE - *ofs)
+    size = FILE_SIZE - *ofs;
+  ASSERT (file_write_at (file, buf, size, *ofs) == (off_t) size);
+  *ofs += size;
+}
+
+/* Reads all of FILE, MAX_WRITE bytes at a time into BUF, and
+   returns how long that took. */
+static int64_t
+read_back (struct file *file, char *buf)
+{
+  int64_t start = timer_ticks ();
+  off_t ofs;
+
+  for (ofs = 0; ofs < FILE_SIZE; ofs += MAX_WRITE)
+    ASSERT (file_read_at (file, buf, MAX_WRITE, ofs) == MAX_WRITE);
+  return timer_elapsed (start);
+}
@@ -0,0 +1,47 @@
+#include "tests/internal/bench.h"
+#include <debug.h>
+#include <string.h>
+#include <stdio.h>
+
+/* In-kernel benchmarks.  They are built into every kernel with
+   USERPROG and FILESYS and run from the kernel command line with
+   the "bench" action, e.g. "pintos -- -q bench cache".  Each one
+   prints its timings and then "NAME: PASS". */
+
+struct bench 
+  {
+    const char *name;
+    bench_func *function;
+  };
+
+static const struct bench benches[] =
+  {
+    {"cache", bench_cache},
+    {"ide-dma", bench_ide_dma},
+    {"alloc", bench_alloc},
+    {"bitmap", bench_bitmap},
+    {"dir", bench_dir},
+    {"par-read", bench_par_read},
+    {"fd", bench_fd},
+    {"read-ahead", bench_read_ahead},
+#ifdef VM
+    {"mmap", bench_mmap},
+    {"share", bench_share},
+    {"fork", bench_fork},
+#endif
+  };
+
+/* Runs the benchmark named NAME. */
+void
+run_bench (const char *name) 
+{
+  const struct bench *b;
+
+  for (b = benches; b < benches + sizeof benches / sizeof *benches; b++)
+    if (!strcmp (name, b->name))
+      {
+        b->function ();
+        return;
+      }
+  PANIC ("no benchmark named \"%s\"", name);
+}
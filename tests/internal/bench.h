@@ -0,0 +1,20 @@
+#ifndef TESTS_INTERNAL_BENCH_H
+#define TESTS_INTERNAL_BENCH_H
+
+void run_bench (const char *);
+
+typedef void bench_func (void);
+
+extern bench_func bench_cache;
+extern bench_func bench_ide_dma;
+extern bench_func bench_alloc;
+extern bench_func bench_bitmap;
+extern bench_func bench_dir;
+extern bench_func bench_par_read;
+extern bench_func bench_fd;
+extern bench_func bench_read_ahead;
+extern bench_func bench_mmap;
+extern bench_func bench_share;
+extern bench_func bench_fork;
+
+#endif /* tests/internal/bench.h */
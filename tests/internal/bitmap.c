@@ -0,0 +1,85 @@
+/* Benchmark for bitmap_scan() in lib/kernel/bitmap.c.
+
+   Builds a 1M-bit map, large enough to get a summary layer, fills
+   it to several ratios, and times runs of scans for 1, 8 and 64
+   false bits from random starting points.  Two fill patterns are
+   tried: bits set at random, and a solidly set prefix like the one
+   a first-fit allocator leaves behind, which the summary lets the
+   scan skip a few thousand bits at a time.
+
+   Run with "pintos -- -q bench bitmap".  It needs no disk. */
+
+#undef NDEBUG
+#include <bitmap.h>
+#include <debug.h>
+#include <inttypes.h>
+#include <random.h>
+#include <stdio.h>
+#include "devices/timer.h"
+#include "tests/internal/bench.h"
+
+/* Bits in the map. */
+#define BIT_CNT (1024 * 1024)
+
+/* Scans timed per fill ratio and group size. */
+#define SCAN_CNT 1000
+
+static void bench_fill (struct bitmap *, int percent, bool prefix);
+
+/* Times bitmap_scan() at several fill ratios. */
+void
+bench_bitmap (void)
+{
+  static const int percents[] = {0, 50, 90, 99};
+  struct bitmap *b = bitmap_create (BIT_CNT);
+  size_t i;
+
+  ASSERT (b != NULL);
+  for (i = 0; i < sizeof percents / sizeof *percents; i++)
+    {
+      bench_fill (b, percents[i], false);
+      bench_fill (b, percents[i], true);
+    }
+  bitmap_destroy (b);
+  printf ("bitmap: PASS\n");
+}
+
+/* Sets PERCENT percent of the bits of B, at random or as a
+   prefix if PREFIX, and times SCAN_CNT scans for each group
+   size. */
+static void
+bench_fill (struct bitmap *b, int percent, bool prefix)
+{
+  static const size_t cnts[] = {1, 8, 64};
+  size_t i, j;
+
+  bitmap_set_all (b, false);
+  if (prefix)
+    bitmap_set_multiple (b, 0, (size_t) BIT_CNT / 100 * percent, true);
+  else
+    for (i = 0; i < BIT_CNT; i++)
+      if (random_ulong () % 100 < (unsigned long) percent)
+        bitmap_mark (b, i);
+
+  for (j = 0; j < sizeof cnts / sizeof *cnts; j++)
+    {
+      size_t found = 0;
+      int64_t start = timer_ticks (), ticks;
+
+      for (i = 0; i < SCAN_CNT; i++)
+        {
+          size_t idx = bitmap_scan (b, random_ulong () % BIT_CNT, cnts[j],
+                                    false);
+          if (idx != BITMAP_ERROR)
+            {
+              ASSERT (bitmap_none (b, idx, cnts[j]));
+              found++;
+            }
+        }
+      ticks = timer_elapsed (start);
+      printf ("%2d%% %s, %2zu bits: %zu of %d found in %"PRId64" ticks "
+              "(%"PRId64" us/scan)\n",
+              percent, prefix ? "prefix" : "random", cnts[j], found, SCAN_CNT,
+              ticks, ticks * (1000000 / TIMER_FREQ) / SCAN_CNT);
+    }
+}
@@ -0,0 +1,94 @@
+/* Microbenchmark for the buffer cache index in filesys/cache.c.
+
+   Fills the cache index with 64, 512, and 4096 entries and times
+   a long run of hits through block_in_cache(), which is the
+   lookup every cache_block_get() pays.  With the sector-keyed
+   hash the time per hit should stay flat as the cache grows.
+
+   Run with "pintos -m 16 -- -q bench cache": 4096 cache blocks
+   need about 2.2 MB of kernel pool. */
+
+#undef NDEBUG
+#include <debug.h>
+#include <inttypes.h>
+#include <random.h>
+#include <stdio.h>
+#include "devices/timer.h"
+#include "filesys/cache.h"
+#include "tests/internal/bench.h"
+#include "threads/malloc.h"
+
+/* Number of lookups timed at each cache size. */
+#define LOOKUP_CNT 200000
+
+/* First fake sector number, well past any real disk. */
+#define FAKE_SECTOR_BASE 0x40000000
+
+static void bench_size (size_t size);
+
+/* Times cache hits at several cache sizes. */
+void
+bench_cache (void)
+{
+  static const size_t sizes[] = {64, 512, 4096};
+  size_t i;
+
+  for (i = 0; i < sizeof sizes / sizeof *sizes; i++)
+    bench_size (sizes[i]);
+  printf ("cache: PASS\n");
+}
+
+/* Inserts SIZE fake blocks into the cache index, times
+   LOOKUP_CNT random hits, and removes the blocks again. */
+static void
+bench_size (size_t size)
+{
+  struct cache_block **blocks;
+  int64_t start, ticks;
+  size_t i;
+
+  blocks = malloc (size * sizeof *blocks);
+  ASSERT (blocks != NULL);
+
+  for (i = 0; i < size; i++)
+    {
+      struct cache_shard *s;
+
+      blocks[i] = calloc (1, sizeof *blocks[i]);
+      ASSERT (blocks[i] != NULL);
+      blocks[i]->sector = FAKE_SECTOR_BASE + i;
+      s = cache_shard_for (blocks[i]->sector);
+      lock_acquire (&s->lock);
+      hash_insert (&s->map, &blocks[i]->hash_elem);
+      lock_release (&s->lock);
+    }
+
+  /* Each hit takes and drops its shard lock, as cache_block_get()
+     does. */
+  start = timer_ticks ();
+  for (i = 0; i < LOOKUP_CNT; i++)
+    {
+      block_sector_t sector = FAKE_SECTOR_BASE + random_ulong () % size;
+      struct cache_shard *s = cache_shard_for (sector);
+
+      lock_acquire (&s->lock);
+      ASSERT (block_in_cache (sector)->sector == sector);
+      lock_release (&s->lock);
+    }
+  ticks = timer_elapsed (start);
+
+  for (i = 0; i < size; i++)
+    {
+      struct cache_shard *s = cache_shard_for (blocks[i]->sector);
+
+      lock_acquire (&s->lock);
+      hash_delete (&s->map, &blocks[i]->hash_elem);
+      lock_release (&s->lock);
+      free (blocks[i]);
+    }
+  free (blocks);
+
+  printf ("%4zu entries: %d hits in %"PRId64" ticks (%"PRId64" ns/hit)\n",
+          size, LOOKUP_CNT, ticks,
+          ticks * (1000000000 / TIMER_FREQ) / LOOKUP_CNT);
+}
@@ -0,0 +1,109 @@
+/* Benchmark for directory lookups in filesys/directory.c.
+
+   Grows one linear and one indexed directory to 10,000 entries,
+   like grow-dir-lg on a larger scale, and after every 1,000 adds
+   times a run of lookups of random names already present.  A
+   linear lookup reads the entries one by one until it finds the
+   name, so its time grows with the directory; an indexed lookup
+   reads one block per index level and one leaf, so it should
+   stay flat.
+
+   All the entries name a single empty file, so apart from the
+   directories themselves no disk space is used.  Run with
+   "pintos -- -q bench dir" on a formatted file system disk with
+   about 600 kB free. */
+
+#undef NDEBUG
+#include <debug.h>
+#include <inttypes.h>
+#include <random.h>
+#include <stdio.h>
+#include "devices/timer.h"
+#include "filesys/directory.h"
+#include "filesys/free-map.h"
+#include "filesys/inode.h"
+#include "tests/internal/bench.h"
+
+/* Entries in each directory at the end. */
+#define ENTRY_CNT 10000
+
+/* Number of times lookups are timed while growing. */
+#define STEP_CNT 10
+
+/* Lookups timed at each step. */
+#define LOOKUP_CNT 1000
+
+static void bench_format (const char *format, block_sector_t target);
+
+/* Compares lookups in growing linear and indexed directories. */
+void
+bench_dir (void)
+{
+  block_sector_t target;
+  struct inode *file;
+
+  ASSERT (free_map_allocate (1, &target));
+  ASSERT (inode_create (target, 0, false));
+  file = inode_open (target);
+  ASSERT (file != NULL);
+
+  bench_format ("linear", target);
+  bench_format ("indexed", target);
+  dir_set_format ("indexed");
+
+  inode_remove (file);
+  inode_close (file);
+  printf ("dir: PASS\n");
+}
+
+/* Creates a directory in FORMAT, fills it with ENTRY_CNT names
+   for the inode in TARGET, and prints the time taken by adds and
+   lookups at each step.  Deletes the directory again. */
+static void
+bench_format (const char *format, block_sector_t target)
+{
+  block_sector_t sector;
+  struct dir *dir;
+  size_t cnt = 0;
+  int step;
+
+  ASSERT (dir_set_format (format));
+  ASSERT (free_map_allocate (1, &sector));
+  ASSERT (dir_create (sector, 0));
+  dir = dir_open (inode_open (sector));
+  ASSERT (dir != NULL);
+
+  for (step = 1; step <= STEP_CNT; step++)
+    {
+      int64_t start, add_ticks, lookup_ticks;
+      char name[NAME_MAX + 1];
+      int i;
+
+      start = timer_ticks ();
+      for (; cnt < (size_t) ENTRY_CNT / STEP_CNT * step; cnt++)
+        {
+          snprintf (name, sizeof name, "file%zu", cnt);
+          ASSERT (dir_add (dir, name, target));
+        }
+      add_ticks = timer_elapsed (start);
+
+      start = timer_ticks ();
+      for (i = 0; i < LOOKUP_CNT; i++)
+        {
+          struct inode *inode;
+
+          snprintf (name, sizeof name, "file%lu", random_ulong () % cnt);
+          ASSERT (dir_lookup (dir, name, &inode));
+          inode_close (inode);
+        }
+      lookup_ticks = timer_elapsed (start);
+
+      printf ("%-7s %5zu entries: %4d adds in %"PRId64" ticks, "
+              "%d lookups in %"PRId64" ticks (%"PRId64" us/lookup)\n",
+              format, cnt, ENTRY_CNT / STEP_CNT, add_ticks, LOOKUP_CNT,
+              lookup_ticks, lookup_ticks * (1000000 / TIMER_FREQ) / LOOKUP_CNT);
+    }
+
+  inode_remove (dir_get_inode (dir));
+  dir_close (dir);
+}
@@ -0,0 +1,62 @@
+/* Microbenchmark for the per-process file descriptor table in
+   userprog/syscall.c.
+
+   Runs child-fds with 1, 64, and 512 descriptors open, once
+   without and once with CALL_CNT pairs of tell() and filesize()
+   calls on the descriptor opened last, and prints the difference
+   per system call.  Descriptors index the table directly, so the
+   cost per call should stay flat as the number of open files
+   grows, where a search of a list of open files grows with it.
+
+   Run with "pintos -- -q bench fd" on a formatted file system disk
+   holding child-fds and sample.txt, e.g. by adding
+   "-p tests/userprog/child-fds -a child-fds
+   -p ../../tests/userprog/sample.txt -a sample.txt". */
+
+#undef NDEBUG
+#include <debug.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include "devices/timer.h"
+#include "tests/internal/bench.h"
+#include "userprog/process.h"
+
+/* Pairs of system calls made by each timed child. */
+#define CALL_CNT 20000
+
+static int64_t run_child (int open_cnt, int call_cnt);
+
+/* Times system calls with several numbers of open files. */
+void
+bench_fd (void)
+{
+  static const int open_cnts[] = {1, 64, 512};
+  size_t i;
+
+  for (i = 0; i < sizeof open_cnts / sizeof *open_cnts; i++)
+    {
+      int64_t base = run_child (open_cnts[i], 0);
+      int64_t ticks = run_child (open_cnts[i], CALL_CNT) - base;
+
+      printf ("%3d fds open: %d calls in %"PRId64" ticks (%"PRId64" ns/call)\n",
+              open_cnts[i], 2 * CALL_CNT, ticks,
+              ticks * (1000000000 / TIMER_FREQ) / (2 * CALL_CNT));
+    }
+  printf ("fd: PASS\n");
+}
+
+/* Runs child-fds with OPEN_CNT files open and CALL_CNT pairs of
+   calls, and returns how many ticks it took. */
+static int64_t
+run_child (int open_cnt, int call_cnt)
+{
+  char cmd[32];
+  int64_t start = timer_ticks ();
+  tid_t child;
+
+  snprintf (cmd, sizeof cmd, "child-fds %d %d", open_cnt, call_cnt);
+  child = process_execute (cmd);
+  ASSERT (child != TID_ERROR);
+  ASSERT (process_wait (child) == open_cnt);
+  return timer_elapsed (start);
+}
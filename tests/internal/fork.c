@@ -0,0 +1,65 @@
+/* Benchmark for fork() against exec() of the same binary.
+
+   Runs child-fork ROUND_CNT times in each mode.  In "fork" mode it
+   forks CHILD_CNT children that exit at once, and in "exec" mode
+   it execs CHILD_CNT copies of itself that exit at once, waiting
+   for each child in turn.  Prints the time each run took.  A fork
+   only shares the parent's pages, while an exec opens and parses
+   the executable and faults its pages in again, so the fork runs
+   should be faster.
+
+   Only built into VM kernels.  Run with "pintos -- -q bench fork"
+   on a file system disk holding child-fork, e.g. by adding
+   "-p tests/vm/child-fork -a child-fork". */
+
+#undef NDEBUG
+#include <debug.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include "devices/timer.h"
+#include "tests/internal/bench.h"
+#include "userprog/process.h"
+
+#ifdef VM
+
+/* Children started in each run. */
+#define CHILD_CNT 50
+
+/* Runs in each mode. */
+#define ROUND_CNT 3
+
+static int64_t run_child (const char *mode);
+
+/* Compares starting processes with fork() and with exec(). */
+void
+bench_fork (void)
+{
+  int i;
+
+  for (i = 0; i < ROUND_CNT; i++)
+    {
+      int64_t exec_ticks = run_child ("exec");
+      int64_t fork_ticks = run_child ("fork");
+
+      printf ("round %d: %d exec() %"PRId64" ticks, "
+              "%d fork() %"PRId64" ticks\n",
+              i + 1, CHILD_CNT, exec_ticks, CHILD_CNT, fork_ticks);
+    }
+  printf ("fork: PASS\n");
+}
+
+/* Runs child-fork in MODE and returns how many ticks it took. */
+static int64_t
+run_child (const char *mode)
+{
+  char cmd[32];
+  int64_t start = timer_ticks ();
+  tid_t child;
+
+  snprintf (cmd, sizeof cmd, "child-fork %s %d", mode, CHILD_CNT);
+  child = process_execute (cmd);
+  ASSERT (child != TID_ERROR);
+  ASSERT (process_wait (child) == 0);
+  return timer_elapsed (start);
+}
+#endif /* VM */
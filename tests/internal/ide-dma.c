@@ -0,0 +1,94 @@
+/* Throughput benchmark for the IDE driver's PIO and DMA paths.
+
+   Reads the first 1 MB of the file system device, the size of a
+   large file, sequentially in 64-sector requests, once by PIO and
+   once by bus master DMA, and prints the time and throughput of
+   each.  Both passes must read the same data.  Skips the DMA pass
+   if no channel may use DMA, as with "-ide-dma=none".
+
+   Run with "pintos -- -q bench ide-dma" on a file system disk of
+   at least 1 MB. */
+
+#undef NDEBUG
+#include <debug.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include "devices/block.h"
+#include "devices/ide.h"
+#include "devices/timer.h"
+#include "tests/internal/bench.h"
+#include "threads/malloc.h"
+
+/* Bytes read in each pass. */
+#define BENCH_BYTES (1024 * 1024)
+
+/* Sectors per block_read_multiple() call. */
+#define REQUEST_SECTORS 64
+
+static uint32_t bench_pass (const char *name, struct block *,
+                            block_sector_t cnt, uint8_t *buffer);
+
+/* Compares PIO and DMA sequential reads. */
+void
+bench_ide_dma (void)
+{
+  struct block *fs = block_get_role (BLOCK_FILESYS);
+  block_sector_t cnt = BENCH_BYTES / BLOCK_SECTOR_SIZE;
+  uint8_t *buffer;
+  uint32_t pio_sum, dma_sum;
+
+  ASSERT (fs != NULL);
+  if (block_size (fs) < cnt)
+    cnt = block_size (fs);
+  buffer = malloc (REQUEST_SECTORS * BLOCK_SECTOR_SIZE);
+  ASSERT (buffer != NULL);
+
+  if (!ide_set_dma (false))
+    {
+      bench_pass ("PIO", fs, cnt, buffer);
+      printf ("no DMA-capable channel, DMA pass skipped\n");
+    }
+  else
+    {
+      pio_sum = bench_pass ("PIO", fs, cnt, buffer);
+      ide_set_dma (true);
+      dma_sum = bench_pass ("DMA", fs, cnt, buffer);
+      ASSERT (pio_sum == dma_sum);
+    }
+
+  free (buffer);
+  printf ("ide-dma: PASS\n");
+}
+
+/* Reads the first CNT sectors of BLOCK into BUFFER, which holds
+   REQUEST_SECTORS sectors, prints how long it took, and returns a
+   checksum of the data. */
+static uint32_t
+bench_pass (const char *name, struct block *block, block_sector_t cnt,
+            uint8_t *buffer)
+{
+  void *sectors[REQUEST_SECTORS];
+  uint32_t sum = 0;
+  block_sector_t sector;
+  int64_t start, ticks;
+  size_t i;
+
+  for (i = 0; i < REQUEST_SECTORS; i++)
+    sectors[i] = buffer + i * BLOCK_SECTOR_SIZE;
+
+  start = timer_ticks ();
+  for (sector = 0; sector < cnt; sector += REQUEST_SECTORS)
+    {
+      size_t n = cnt - sector < REQUEST_SECTORS ? cnt - sector : REQUEST_SECTORS;
+      block_read_multiple (block, sector, n, sectors);
+      for (i = 0; i < n * BLOCK_SECTOR_SIZE; i++)
+        sum = sum * 31 + buffer[i];
+    }
+  ticks = timer_elapsed (start);
+
+  printf ("%s: %"PRDSNu" sectors in %"PRId64" ticks (%"PRId64" kB/s)\n",
+          name, cnt, ticks,
+          ticks > 0 ? (int64_t) cnt / 2 * TIMER_FREQ / ticks : 0);
+  return sum;
+}
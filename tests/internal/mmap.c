@@ -0,0 +1,92 @@
+/* Benchmark for scanning a file through mmap() and through
+   read().
+
+   Writes a 1 MB file of random bytes, "scan.dat", then runs
+   child-mmap-scan over it ROUND_CNT times in each mode and prints
+   the time each run took.  Both modes must add up to the same sum.
+   A read() copies every byte from the buffer cache into the
+   user's buffer, while a mapped page is read into its frame once
+   and then touched in place, so the mmap runs should be faster.
+
+   Only built into VM kernels.  Run with "pintos -- -q bench mmap"
+   on a formatted file system disk of at least 2 MB holding
+   child-mmap-scan, e.g. by adding
+   "-p tests/vm/child-mmap-scan -a child-mmap-scan". */
+
+#undef NDEBUG
+#include <debug.h>
+#include <inttypes.h>
+#include <random.h>
+#include <stdio.h>
+#include "devices/timer.h"
+#include "filesys/file.h"
+#include "filesys/filesys.h"
+#include "tests/internal/bench.h"
+#include "threads/palloc.h"
+#include "threads/vaddr.h"
+#include "userprog/process.h"
+
+#ifdef VM
+
+/* Size of the file scanned. */
+#define FILE_SIZE (1024 * 1024)
+
+/* Runs in each mode. */
+#define ROUND_CNT 3
+
+static int run_child (const char *mode, int64_t *ticks);
+
+/* Compares scanning a file with mmap() and with read(). */
+void
+bench_mmap (void)
+{
+  uint8_t *page = palloc_get_page (PAL_ASSERT);
+  struct file *file;
+  int sum = 0;
+  int i, j;
+
+  random_init (0);
+  filesys_remove ("scan.dat");
+  ASSERT (filesys_create ("scan.dat", 0, false));
+  file = filesys_open ("scan.dat");
+  ASSERT (file != NULL);
+  for (i = 0; i < FILE_SIZE / PGSIZE; i++)
+    {
+      random_bytes (page, PGSIZE);
+      for (j = 0; j < PGSIZE; j++)
+        sum += page[j];
+      ASSERT (file_write (file, page, PGSIZE) == PGSIZE);
+    }
+  file_close (file);
+  palloc_free_page (page);
+
+  for (i = 0; i < ROUND_CNT; i++)
+    {
+      int64_t read_ticks, mmap_ticks;
+
+      ASSERT (run_child ("read", &read_ticks) == sum);
+      ASSERT (run_child ("mmap", &mmap_ticks) == sum);
+      printf ("round %d: read() %"PRId64" ticks, mmap() %"PRId64" ticks\n",
+              i + 1, read_ticks, mmap_ticks);
+    }
+  printf ("mmap: PASS\n");
+}
+
+/* Runs child-mmap-scan in MODE, stores how many ticks it took in
+   *TICKS, and returns the child's sum. */
+static int
+run_child (const char *mode, int64_t *ticks)
+{
+  char cmd[32];
+  int64_t start = timer_ticks ();
+  tid_t child;
+  int sum;
+
+  snprintf (cmd, sizeof cmd, "child-mmap-scan %s", mode);
+  child = process_execute (cmd);
+  ASSERT (child != TID_ERROR);
+  sum = process_wait (child);
+  *ticks = timer_elapsed (start);
+  return sum;
+}
+#endif /* VM */
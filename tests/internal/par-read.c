@@ -0,0 +1,93 @@
+/* Multi-process read benchmark for the file system calls.
+
+   Writes the four 32 kB files that child-par-read expects, then
+   runs the four children of par-read first one after another and
+   then all at once, and prints how long each takes.  The files
+   together are bigger than the default 64-sector buffer cache, so
+   every child keeps going to the disk.  With the file system
+   locking internally instead of under one global lock in the
+   system call layer, one child's reads can proceed while another
+   waits for the disk, so the concurrent run should take clearly
+   less time than the sequential one.
+
+   Run with "pintos -- -q bench par-read" on a formatted file system
+   disk holding child-par-read, e.g. by adding
+   "-p tests/filesys/extended/child-par-read -a child-par-read". */
+
+#undef NDEBUG
+#include <debug.h>
+#include <inttypes.h>
+#include <random.h>
+#include <stdio.h>
+#include "devices/timer.h"
+#include "filesys/file.h"
+#include "filesys/filesys.h"
+#include "tests/filesys/extended/par-read.h"
+#include "tests/internal/bench.h"
+#include "threads/malloc.h"
+#include "userprog/process.h"
+
+static int64_t run_children (bool concurrent);
+
+/* Compares sequential and concurrent runs of child-par-read. */
+void
+bench_par_read (void)
+{
+  char *buf = malloc (FILE_SIZE * CHILD_CNT);
+  int64_t serial, parallel;
+  int i;
+
+  ASSERT (buf != NULL);
+  random_init (0);
+  random_bytes (buf, FILE_SIZE * CHILD_CNT);
+  for (i = 0; i < CHILD_CNT; i++)
+    {
+      char file_name[16];
+      struct file *file;
+
+      snprintf (file_name, sizeof file_name, "data%d", i);
+      filesys_remove (file_name);
+      ASSERT (filesys_create (file_name, 0, false));
+      file = filesys_open (file_name);
+      ASSERT (file != NULL);
+      ASSERT (file_write (file, buf + i * FILE_SIZE, FILE_SIZE) == FILE_SIZE);
+      file_close (file);
+    }
+  free (buf);
+
+  serial = run_children (false);
+  parallel = run_children (true);
+  printf ("%d readers one at a time: %"PRId64" ticks\n", CHILD_CNT, serial);
+  printf ("%d readers at once: %"PRId64" ticks (%"PRId64"%% of one at a time)\n",
+          CHILD_CNT, parallel, serial > 0 ? parallel * 100 / serial : 0);
+  printf ("par-read: PASS\n");
+}
+
+/* Runs the CHILD_CNT children, all at once if CONCURRENT, and
+   returns how many ticks they took. */
+static int64_t
+run_children (bool concurrent)
+{
+  tid_t children[CHILD_CNT];
+  int64_t start = timer_ticks ();
+  int i;
+
+  for (i = 0; i < CHILD_CNT; i++)
+    {
+      char cmd[32];
+
+      snprintf (cmd, sizeof cmd, "child-par-read %d", i);
+      children[i] = process_execute (cmd);
+      ASSERT (children[i] != TID_ERROR);
+      if (!concurrent)
+        {
+          ASSERT (process_wait (children[i]) == i);
+        }
+    }
+  if (concurrent)
+    {
+      for (i = 0; i < CHILD_CNT; i++)
+        ASSERT (process_wait (children[i]) == i);
+    }
+  return timer_elapsed (start);
+}
@@ -0,0 +1,124 @@
+/* Sequential read benchmark for read-ahead in filesys/inode.c and
+   filesys/cache.c.
+
+   Grows a 72943-byte file in 1234-byte writes, as grow-seq-lg
+   does, then reads it back in the same chunks, once from front to
+   back and once from back to front, each time after reading
+   another file that pushes it out of the default 64-sector buffer
+   cache.  Only the front-to-back pass is seen as sequential, so
+   only it gets its sectors read ahead while the caller copies the
+   previous ones, and it should take clearly less time.
+
+   Run with "pintos -- -q bench read-ahead" on a formatted file
+   system disk with at least 200 kB free. */
+
+#undef NDEBUG
+#include <debug.h>
+#include <inttypes.h>
+#include <random.h>
+#include <stdio.h>
+#include "devices/timer.h"
+#include "filesys/cache.h"
+#include "filesys/file.h"
+#include "filesys/filesys.h"
+#include "tests/internal/bench.h"
+#include "threads/malloc.h"
+
+/* Size of the file read back, and of each read and write, as in
+   grow-seq-lg. */
+#define FILE_SIZE 72943
+#define CHUNK_SIZE 1234
+
+/* Size of the file read to empty the cache. */
+#define EVICT_SIZE (128 * 1024)
+
+/* Passes timed in each direction. */
+#define ROUNDS 10
+
+static struct file *make_file (const char *name, const char *buf,
+                               size_t size, size_t chunk);
+static void read_all (struct file *, char *buf, size_t size);
+static int64_t read_chunks (struct file *, char *buf, bool forward);
+
+/* Compares forward and backward reads of a grow-seq-lg file. */
+void
+bench_read_ahead (void)
+{
+  char *buf = malloc (EVICT_SIZE);
+  struct file *data, *evict;
+  int64_t forward = 0, backward = 0;
+  int i;
+
+  ASSERT (buf != NULL);
+  random_init (0);
+  random_bytes (buf, EVICT_SIZE);
+  data = make_file ("ra-data", buf, FILE_SIZE, CHUNK_SIZE);
+  evict = make_file ("ra-evict", buf, EVICT_SIZE, EVICT_SIZE);
+
+  for (i = 0; i < ROUNDS; i++)
+    {
+      read_all (evict, buf, EVICT_SIZE);
+      forward += read_chunks (data, buf, true);
+      read_all (evict, buf, EVICT_SIZE);
+      backward += read_chunks (data, buf, false);
+    }
+  printf ("%d sequential reads: %"PRId64" ticks\n", ROUNDS, forward);
+  printf ("%d backward reads: %"PRId64" ticks (sequential took %"PRId64"%%)\n",
+          ROUNDS, backward, backward > 0 ? forward * 100 / backward : 0);
+  cache_print_stats ();
+
+  file_close (data);
+  file_close (evict);
+  filesys_remove ("ra-data");
+  filesys_remove ("ra-evict");
+  free (buf);
+  printf ("read-ahead: PASS\n");
+}
+
+/* Creates file NAME and writes the SIZE bytes in BUF to it, CHUNK
+   bytes at a time.  Returns the open file. */
+static struct file *
+make_file (const char *name, const char *buf, size_t size, size_t chunk)
+{
+  struct file *file;
+  size_t ofs;
+
+  filesys_remove (name);
+  ASSERT (filesys_create (name, 0, false));
+  file = filesys_open (name);
+  ASSERT (file != NULL);
+  for (ofs = 0; ofs < size; ofs += chunk)
+    {
+      size_t n = size - ofs < chunk ? size - ofs : chunk;
+      ASSERT (file_write_at (file, buf + ofs, n, ofs) == (off_t) n);
+    }
+  return file;
+}
+
+/* Reads all SIZE bytes of FILE into BUF. */
+static void
+read_all (struct file *file, char *buf, size_t size)
+{
+  ASSERT (file_read_at (file, buf, size, 0) == (off_t) size);
+}
+
+/* Reads the data file into BUF a chunk at a time, first chunk first
+   if FORWARD, last chunk first otherwise, and returns how long that
+   took. */
+static int64_t
+read_chunks (struct file *file, char *buf, bool forward)
+{
+  int64_t start = timer_ticks ();
+  size_t chunk_cnt = (FILE_SIZE + CHUNK_SIZE - 1) / CHUNK_SIZE;
+  size_t i;
+
+  for (i = 0; i < chunk_cnt; i++)
+    {
+      size_t idx = forward ? i : chunk_cnt - 1 - i;
+      off_t ofs = idx * CHUNK_SIZE;
+      off_t n = FILE_SIZE - ofs < CHUNK_SIZE ? FILE_SIZE - ofs : CHUNK_SIZE;
+
+      ASSERT (file_read_at (file, buf + ofs, n, ofs) == n);
+    }
+  return timer_elapsed (start);
+}
@@ -0,0 +1,55 @@
+/* Benchmark for sharing read-only executable pages between
+   processes.
+
+   Starts CHILD_CNT copies of child-simple at once, waits for all
+   of them, and prints how long that took, ROUND_CNT times, then
+   prints the share table statistics.  Every copy after the first
+   should map the text pages that are already resident instead of
+   reading them again, so the hits should far outnumber the loads.
+
+   Only built into VM kernels.  Run with "pintos -- -q bench share"
+   on a file system disk holding child-simple, e.g. by adding
+   "-p tests/userprog/child-simple -a child-simple". */
+
+#undef NDEBUG
+#include <debug.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include "devices/timer.h"
+#include "tests/internal/bench.h"
+#include "userprog/process.h"
+#include "vm/share.h"
+
+#ifdef VM
+
+/* Processes started together. */
+#define CHILD_CNT 16
+
+/* Rounds timed. */
+#define ROUND_CNT 3
+
+/* Times starting many processes that run the same executable. */
+void
+bench_share (void)
+{
+  tid_t children[CHILD_CNT];
+  int i, j;
+
+  for (i = 0; i < ROUND_CNT; i++)
+    {
+      int64_t start = timer_ticks ();
+
+      for (j = 0; j < CHILD_CNT; j++)
+        {
+          children[j] = process_execute ("child-simple");
+          ASSERT (children[j] != TID_ERROR);
+        }
+      for (j = 0; j < CHILD_CNT; j++)
+        ASSERT (process_wait (children[j]) == 81);
+      printf ("round %d: %d processes in %"PRId64" ticks\n",
+              i + 1, CHILD_CNT, timer_elapsed (start));
+    }
+  share_print_stats ();
+  printf ("share: PASS\n");
+}
+#endif /* VM */
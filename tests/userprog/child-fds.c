@@ -0,0 +1,34 @@
+/* Child process for the fd benchmark in tests/internal/fd.c.
+   Opens "sample.txt" N times, then makes CNT tell() and
+   filesize() calls on the descriptor opened last, and exits
+   with the number of descriptors it opened. */
+
+#include <stdlib.h>
+#include <syscall.h>
+#include "tests/lib.h"
+
+const char *test_name = "child-fds";
+
+int
+main (int argc, const char *argv[]) 
+{
+  int open_cnt, call_cnt;
+  int fd = -1;
+  int i;
+
+  quiet = true;
+
+  CHECK (argc == 3, "argc must be 3, actually %d", argc);
+  open_cnt = atoi (argv[1]);
+  call_cnt = atoi (argv[2]);
+
+  for (i = 0; i < open_cnt; i++)
+    CHECK ((fd = open ("sample.txt")) > 1, "open \"sample.txt\"");
+  for (i = 0; i < call_cnt; i++)
+    {
+      tell (fd);
+      filesize (fd);
+    }
+
+  return open_cnt;
+}
@@ -0,0 +1,24 @@
+/* Opens "sample.txt" three times, closes the middle descriptor,
+   and opens it again, which must hand back the descriptor just
+   closed, since it is the lowest one free. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void) 
+{
+  int h1, h2, h3, h4;
+
+  CHECK ((h1 = open ("sample.txt")) > 1, "open \"sample.txt\" once");
+  CHECK ((h2 = open ("sample.txt")) > 1, "open \"sample.txt\" again");
+  CHECK ((h3 = open ("sample.txt")) > 1, "open \"sample.txt\" a third time");
+  msg ("close second handle");
+  close (h2);
+  CHECK ((h4 = open ("sample.txt")) > 1, "open \"sample.txt\" after close");
+  if (h4 != h2)
+    fail ("open() returned %d, expected freed handle %d", h4, h2);
+  if (h4 == h1 || h4 == h3)
+    fail ("open() returned %d, which is still open", h4);
+}
@@ -0,0 +1,15 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(open-reuse) begin
+(open-reuse) open "sample.txt" once
+(open-reuse) open "sample.txt" again
+(open-reuse) open "sample.txt" a third time
+(open-reuse) close second handle
+(open-reuse) open "sample.txt" after close
+(open-reuse) end
+open-reuse: exit(0)
+EOF
+pass;
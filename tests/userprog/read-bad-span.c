@@ -0,0 +1,18 @@
+/* Passes the read system call a buffer that starts in valid user
+   memory, at the top of the stack, and runs past the end of user
+   memory into the kernel.
+   The process must be terminated with -1 exit code. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void) 
+{
+  int handle;
+  CHECK ((handle = open ("sample.txt")) > 1, "open \"sample.txt\"");
+
+  read (handle, (char *) 0xc0000000 - 16, 123);
+  fail ("should have exited with -1");
+}
@@ -0,0 +1,10 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(read-bad-span) begin
+(read-bad-span) open "sample.txt"
+read-bad-span: exit(-1)
+EOF
+pass;
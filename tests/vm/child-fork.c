@@ -0,0 +1,41 @@
+/* Child process for the fork benchmark in tests/internal/fork.c.
+   With arguments "fork N", forks N times and waits for each child,
+   which exits at once.  With "exec N", does the same by running
+   itself without arguments N times instead.  Without arguments,
+   just exits.  Exits with 0 if every child exited with 0. */
+
+#include <stdlib.h>
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+
+const char *test_name = "child-fork";
+
+int
+main (int argc, char *argv[]) 
+{
+  int cnt, i;
+
+  quiet = true;
+  if (argc == 1)
+    return 0;
+
+  CHECK (argc == 3, "argc must be 3, actually %d", argc);
+  cnt = atoi (argv[2]);
+  for (i = 0; i < cnt; i++)
+    {
+      pid_t pid;
+
+      if (!strcmp (argv[1], "fork"))
+        {
+          pid = fork ();
+          if (pid == 0)
+            exit (0);
+        }
+      else
+        pid = exec ("child-fork");
+      if (pid == PID_ERROR || wait (pid) != 0)
+        return 1;
+    }
+  return 0;
+}
@@ -0,0 +1,49 @@
+/* Child process for the mmap benchmark in tests/internal/mmap.c.
+   Adds up the bytes of "scan.dat", either read() through a 4 kB
+   buffer or mapped with mmap(), as chosen by its argument, and
+   exits with the sum. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+
+const char *test_name = "child-mmap-scan";
+
+static unsigned char buf[4096];
+
+int
+main (int argc, char *argv[]) 
+{
+  int sum = 0;
+  int fd;
+
+  quiet = true;
+
+  CHECK (argc == 2, "argc must be 2, actually %d", argc);
+  CHECK ((fd = open ("scan.dat")) > 1, "open \"scan.dat\"");
+
+  if (!strcmp (argv[1], "mmap"))
+    {
+      const unsigned char *data = (const unsigned char *) 0x10000000;
+      int size = filesize (fd);
+      mapid_t map;
+      int i;
+
+      CHECK ((map = mmap (fd, (void *) data)) != MAP_FAILED,
+             "mmap \"scan.dat\"");
+      for (i = 0; i < size; i++)
+        sum += data[i];
+      munmap (map);
+    }
+  else
+    {
+      int n, i;
+
+      while ((n = read (fd, buf, sizeof buf)) > 0)
+        for (i = 0; i < n; i++)
+          sum += buf[i];
+    }
+  close (fd);
+
+  return sum;
+}
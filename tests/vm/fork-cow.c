@@ -0,0 +1,66 @@
+/* Forks with a buffer filled and a file open, has the child check
+   and then overwrite its copy of the buffer and read the file, and
+   verifies that the parent's copy of the buffer did not change
+   and that its file position did not move. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/vm/sample.inc"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define BUF_SIZE (3 * 4096)
+
+static char buf[BUF_SIZE];
+
+/* Runs in the child.  Returns 81 if everything looks right. */
+static int
+child (int handle)
+{
+  char data[sizeof sample];
+  size_t i;
+
+  for (i = 0; i < BUF_SIZE; i++)
+    if (buf[i] != 'a')
+      return 1;
+  memset (buf, 'b', BUF_SIZE);
+  for (i = 0; i < BUF_SIZE; i++)
+    if (buf[i] != 'b')
+      return 2;
+  if (read (handle, data, strlen (sample)) != (int) strlen (sample)
+      || memcmp (data, sample, strlen (sample)))
+    return 3;
+  return 81;
+}
+
+void
+test_main (void)
+{
+  char data[sizeof sample];
+  int handle;
+  pid_t pid;
+  int status;
+  size_t i;
+
+  CHECK ((handle = open ("sample.txt")) > 1, "open \"sample.txt\"");
+  memset (buf, 'a', BUF_SIZE);
+
+  pid = fork ();
+  if (pid == 0)
+    exit (child (handle));
+  if (pid == PID_ERROR)
+    fail ("fork failed");
+
+  /* Print nothing until the child is done, so that the output
+     comes out in a fixed order. */
+  status = wait (pid);
+  CHECK (status == 81, "wait for child");
+
+  for (i = 0; i < BUF_SIZE; i++)
+    if (buf[i] != 'a')
+      fail ("byte %zu of parent's buffer changed to %02hhx", i, buf[i]);
+  CHECK (read (handle, data, strlen (sample)) == (int) strlen (sample),
+         "read \"sample.txt\"");
+  if (memcmp (data, sample, strlen (sample)))
+    fail ("parent read bad data from \"sample.txt\"");
+}
@@ -28,14 +28,24 @@
 #include "userprog/gdt.h"
 #include "userprog/syscall.h"
 #include "userprog/tss.h"
+#include "tests/internal/bench.h"
 #else
 #include "tests/threads/tests.h"
 #endif
 #ifdef FILESYS
 #include "devices/block.h"
 #include "devices/ide.h"
+#include "filesys/cache.h"
+#include "filesys/dcache.h"
+#include "filesys/directory.h"
 #include "filesys/filesys.h"
 #include "filesys/fsutil.h"
+#include "filesys/inode.h"
+#endif
+#ifdef VM
+#include "vm/frame.h"
+#include "vm/share.h"
+#include "vm/swap.h"
 #endif
 
 /* Page directory with kernel mappings only. */
@@ -127,6 +137,13 @@ main (void)
   filesys_init (format_filesys);
 #endif
 
+#ifdef VM
+  /* Initialize virtual memory. */
+  frame_init ();
+  share_init ();
+  swap_init ();
+#endif
+
   printf ("Boot complete.\n");
   
   /* Run actions specified on kernel command line. */
@@ -259,6 +276,46 @@ parse_options (char **argv)
 #ifdef USERPROG
       else if (!strcmp (name, "-ul"))
         user_page_limit = atoi (value);
+#endif
+#ifdef FILESYS
+      else if (!strcmp (name, "-cache"))
+        cache_configure (atoi (value));
+      else if (!strcmp (name, "-cache-policy"))
+        {
+          if (!cache_set_policy (value))
+            PANIC ("unknown cache policy `%s' (use clock, 2q or arc)", value);
+        }
+      else if (!strcmp (name, "-cache-dirty"))
+        {
+          char *limit = value != NULL ? strchr (value, ',') : NULL;
+          if (limit == NULL)
+            PANIC ("-cache-dirty needs BACKGROUND,LIMIT percentages");
+          cache_configure_dirty (atoi (value), atoi (limit + 1));
+        }
+      else if (!strcmp (name, "-dcache"))
+        dcache_configure (atoi (value));
+      else if (!strcmp (name, "-dir-format"))
+        {
+          if (!dir_set_format (value))
+            PANIC ("unknown directory format `%s' (use indexed or linear)",
+                   value);
+        }
+      else if (!strcmp (name, "-ide-dma"))
+        {
+          if (!ide_configure_dma (value))
+            PANIC ("bad -ide-dma channel list `%s'", value);
+        }
+      else if (!strcmp (name, "-inode-format"))
+        {
+          if (!inode_set_format (value))
+            PANIC ("unknown inode format `%s' (use indexed or extent)", value);
+        }
+      else if (!strcmp (name, "-iosched"))
+        {
+          if (!block_set_scheduler (value))
+            PANIC ("unknown I/O scheduler `%s' (use fifo, clook or deadline)",
+                   value);
+        }
 #endif
       else
         PANIC ("unknown option `%s' (use -h for help)", name);
@@ -292,6 +349,15 @@ run_task (char **argv)
   printf ("Execution of '%s' complete.\n", task);
 }
 
+#ifdef USERPROG
+/* Runs the in-kernel benchmark named in ARGV[1]. */
+static void
+run_bench_action (char **argv)
+{
+  run_bench (argv[1]);
+}
+#endif
+
 /* Executes all of the actions specified in ARGV[]
    up to the null pointer sentinel. */
 static void
@@ -309,6 +375,9 @@ run_actions (char **argv)
   static const struct action actions[] = 
     {
       {"run", 2, run_task},
+#ifdef USERPROG
+      {"bench", 2, run_bench_action},
+#endif
 #ifdef FILESYS
       {"ls", 1, fsutil_ls},
       {"cat", 2, fsutil_cat},
@@ -354,6 +423,7 @@ usage (void)
           "\nAvailable actions:\n"
 #ifdef USERPROG
           "  run 'PROG [ARG...]' Run PROG and wait for it to complete.\n"
+          "  bench NAME         Run in-kernel benchmark NAME.\n"
 #else
           "  run TEST           Run TEST.\n"
 #endif
@@ -381,6 +451,21 @@ usage (void)
           "  -mlfqs             Use multi-level feedback queue scheduler.\n"
 #ifdef USERPROG
           "  -ul=COUNT          Limit user memory to COUNT pages.\n"
+#endif
+#ifdef FILESYS
+          "  -cache=COUNT       Cache COUNT disk sectors (default 64).\n"
+          "  -cache-policy=NAME Replace cached sectors with clock, 2q or arc.\n"
+          "  -cache-dirty=BG,MAX  Start flushing at BG%%, throttle writers\n"
+          "                     at MAX%% of the cache dirty (default 10,40).\n"
+          "  -dcache=COUNT      Cache COUNT directory lookups (default 128).\n"
+          "  -dir-format=NAME   Create directories as indexed (default)\n"
+          "                     hash trees or as linear entry arrays.\n"
+          "  -ide-dma=LIST      Use DMA on IDE channels in LIST, e.g. 0,1\n"
+          "                     (default), or none for PIO only.\n"
+          "  -inode-format=NAME With -f, store file data as indexed (default)\n"
+          "                     pointer blocks or as extent lists.\n"
+          "  -iosched=NAME      Order disk requests by fifo, clook or\n"
+          "                     deadline (default).\n"
 #endif
           );
   shutdown_power_off ();
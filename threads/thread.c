@@ -596,9 +596,13 @@ init_thread (struct thread *t, const char *name, int priority)
   t->parent = running_thread ();
   cond_init (&t->child_condition);
   lock_init (&t->child_cond_lock);
-  list_init (&t->files_owned_list);
-  t->file_desc = 2; //0-STDIN, 1-STDOUT
+  t->fd_table = NULL; //allocated on first open
+  t->fd_table_size = 0;
+  t->fd_next = 2; //0-STDIN, 1-STDOUT
   t->load_status = false;
+#ifdef VM
+  list_init (&t->mappings);
+#endif
    
 
 
@@ -114,6 +114,13 @@ struct thread
     /* Owned by userprog/process.c. */
     uint32_t *pagedir;                  /* Page directory. */
 #endif
+#ifdef VM
+    struct hash *pages;                 /* Supplemental page table. */
+    struct file *exec_file;             /* Executable, open while running. */
+    struct list mappings;               /* Memory-mapped files. */
+    int next_mapid;                     /* Identifier for next mapping. */
+    void *user_esp;                     /* User esp at system call entry. */
+#endif
 
     /* Owned by thread.c. */
     unsigned magic;                     /* Detects stack overflow. */
@@ -142,8 +149,9 @@ struct thread
    struct child_process *chp; //pointer to child_process in parent's list of child
    struct lock child_cond_lock; //lock associated with cond var of child
    struct condition child_condition; //cond var for indicating child's status
-   struct list files_owned_list;     //for handling file sys calls we need file list
-   int file_desc; //file discriptor
+   struct file_struct **fd_table;    //open files, indexed by file descriptor
+   int fd_table_size;                //number of slots in fd_table
+   int fd_next;                      //every descriptor below this is in use
    
    bool load_status;
 //this is to pass sys_exe
@@ -3,8 +3,13 @@
 #include <inttypes.h>
 #include <stdio.h>
 #include "userprog/gdt.h"
+#include "userprog/usercopy.h"
 #include "threads/interrupt.h"
 #include "threads/thread.h"
+#include "threads/vaddr.h"
+#ifdef VM
+#include "vm/page.h"
+#endif
 
 /* Number of page faults processed. */
 static long long page_fault_cnt;
@@ -151,6 +156,36 @@ page_fault (struct intr_frame *f)
   write = (f->error_code & PF_W) != 0;
   user = (f->error_code & PF_U) != 0;
 
+#ifdef VM
+  /* Bring in a page of the process that is not resident yet.  The
+     kernel faults on such pages too, when a system call touches a
+     user buffer. */
+  if (not_present && is_user_vaddr (fault_addr) && page_load (fault_addr))
+    return;
+
+  /* Grow the stack on an access just below it.  A fault in the
+     kernel happens during a system call, so the user's stack
+     pointer is the one saved on entry to it. */
+  if (not_present
+      && page_add_stack (fault_addr,
+                         user ? f->esp : thread_current ()->user_esp)
+      && page_load (fault_addr))
+    return;
+
+  /* Give the process its own copy of a page it shares with a
+     parent or child since fork() on the first write to it. */
+  if (!not_present && write && is_user_vaddr (fault_addr)
+      && page_copy_on_write (fault_addr))
+    return;
+#endif
+
+  /* A system call passed a bad user pointer to usercopy().  Make
+     usercopy() return the number of bytes it did not copy. */
+  if (!user && f->eip == usercopy_insn && is_user_vaddr (fault_addr))
+    {
+      f->eip = usercopy_fixup;
+      return;
+    }
 
   /* To implement virtual memory, delete the rest of the function
      body, and replace it with code that brings in the page to
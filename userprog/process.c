@@ -18,8 +18,25 @@
 #include "threads/palloc.h"
 #include "threads/thread.h"
 #include "threads/vaddr.h"
+#ifdef VM
+#include "vm/mmap.h"
+#include "vm/page.h"
+#endif
 
 static thread_func start_process NO_RETURN;
+#ifdef VM
+static thread_func fork_process NO_RETURN;
+static bool fork_copy (struct thread *parent);
+
+/* Passed from process_fork() to the child's fork_process(). */
+struct fork_info
+  {
+    struct intr_frame if_;              /* Parent's user registers. */
+    struct thread *parent;              /* Process calling fork(). */
+    struct semaphore copied;            /* Upped when the copy is done. */
+    bool success;                       /* Whether the copy succeeded. */
+  };
+#endif
 static bool load (const char *cmdline, void (**eip) (void), void **esp,
                   char ** fp);
 //struct lock file_lock;
@@ -221,6 +238,90 @@ start_process (void *file_name_)
   NOT_REACHED ();
 }
 
+/* Starts a new process that is a copy of the current one, with
+   the user registers in IF_ as they were at the fork() system
+   call, and returns the new process's thread id, or TID_ERROR if
+   it cannot be created.  The new process sees fork() return 0.
+   The processes share their writable pages until one of them
+   writes to one (see vm/share.c), so forking costs time in
+   proportion to the pages the parent has in memory or in swap,
+   not to their size.  Only kernels built with VM support fork(). */
+tid_t
+process_fork (const struct intr_frame *if_)
+{
+#ifdef VM
+  struct fork_info info;
+  tid_t tid;
+
+  info.if_ = *if_;
+  info.parent = thread_current ();
+  sema_init (&info.copied, 0);
+  tid = thread_create (thread_current ()->name, PRI_DEFAULT,
+                       fork_process, &info);
+  if (tid == TID_ERROR)
+    return TID_ERROR;
+
+  /* Wait for the child to copy us.  The child may get there before
+     we do, so this has to be a semaphore rather than a bare
+     thread_block(). */
+  sema_down (&info.copied);
+  return info.success ? tid : TID_ERROR;
+#else
+  (void) if_;
+  return TID_ERROR;
+#endif
+}
+
+#ifdef VM
+/* A thread function that makes the new thread a copy of the
+   process that called fork() and starts it running. */
+static void
+fork_process (void *info_)
+{
+  struct fork_info *info = info_;
+  struct thread *parent = info->parent;
+  struct intr_frame if_ = info->if_;
+  bool success;
+
+  success = fork_copy (parent);
+  if_.eax = 0;
+
+  /* The parent may return from fork(), taking INFO with it, as
+     soon as the semaphore is up. */
+  info->success = success;
+  sema_up (&info->copied);
+  if (!success)
+    thread_exit ();
+
+  asm volatile ("movl %0, %%esp; jmp intr_exit" : : "g" (&if_) : "memory");
+  NOT_REACHED ();
+}
+
+/* Gives the current process a copy of PARENT's address space and
+   open files.  Returns true if successful, false on out of memory,
+   in which case process_exit() frees whatever was copied. */
+static bool
+fork_copy (struct thread *parent)
+{
+  struct thread *t = thread_current ();
+
+  if (!page_table_create ())
+    return false;
+  t->pagedir = pagedir_create ();
+  if (t->pagedir == NULL)
+    return false;
+  process_activate ();
+
+  t->exec_file = file_reopen (parent->exec_file);
+  if (t->exec_file == NULL)
+    return false;
+  file_deny_write (t->exec_file);
+
+  return (page_table_copy (parent, t->exec_file)
+          && copy_all_files (parent));
+}
+#endif
+
 //get process for given pid
 struct child_process * 
 get_process_for_pid (int pid)
@@ -394,6 +495,13 @@ cond_signal (chp->condition, chp->wait_lock);
      dir_close(thread_current()->cwd);
   }  
   printf("%s: exit(%d)\n", cur->name, cur->exit_status);  
+
+#ifdef VM
+  mmap_unmap_all ();
+  page_table_destroy ();
+  file_close (cur->exec_file);
+  cur->exec_file = NULL;
+#endif
   
   /* Destroy the current process's page directory and switch back
      to the kernel-only page directory. */
@@ -515,6 +623,11 @@ load (const char *file_name, void (**eip) (void), void **esp,
   bool success = false;
   int i;
 
+#ifdef VM
+  if (!page_table_create ())
+    goto done;
+#endif
+
   /* Allocate and activate page directory. */
   t->pagedir = pagedir_create ();
   if (t->pagedir == NULL) 
@@ -615,13 +728,27 @@ load (const char *file_name, void (**eip) (void), void **esp,
 
  done:
   /* We arrive here whether the load is successful or not. */
+#ifdef VM
+  /* Pages are read from the executable when first touched, so it
+     stays open, and unmodified, while the process runs. */
+  if (success)
+    {
+      file_deny_write (file);
+      t->exec_file = file;
+    }
+  else
+    file_close (file);
+#else
   file_close (file);
+#endif
   return success;
 }
 
 /* load() helpers. */
 
+#ifndef VM
 static bool install_page (void *upage, void *kpage, bool writable);
+#endif
 
 /* Checks whether PHDR describes a valid, loadable segment in
    FILE and returns true if so, false otherwise. */
@@ -680,6 +807,9 @@ validate_segment (const struct Elf32_Phdr *phdr, struct file *file)
    The pages initialized by this function must be writable by the
    user process if WRITABLE is true, read-only otherwise.
 
+   With VM, the pages are only entered into the supplemental page
+   table here, and read in when the process first touches them.
+
    Return true if successful, false if a memory allocation error
    or disk read error occurs. */
 static bool
@@ -699,6 +829,12 @@ load_segment (struct file *file, off_t ofs, uint8_t *upage,
       size_t page_read_bytes = read_bytes < PGSIZE ? read_bytes : PGSIZE;
       size_t page_zero_bytes = PGSIZE - page_read_bytes;
 
+#ifdef VM
+      if (!page_add_file (upage, file, ofs, page_read_bytes, writable))
+        return false;
+      ofs += page_read_bytes;
+#else
+
       /* Get a page of memory. */
       uint8_t *kpage = palloc_get_page (PAL_USER);
       if (kpage == NULL)
@@ -718,6 +854,7 @@ load_segment (struct file *file, off_t ofs, uint8_t *upage,
           palloc_free_page (kpage);
           return false; 
         }
+#endif
 
       /* Advance. */
       read_bytes -= page_read_bytes;
@@ -854,9 +991,19 @@ static bool
 setup_stack (void **esp, const char *file_name, char **save_ptr) 
 {
   //printf("\n setting up stack:..... %s\n", file_name);
-  uint8_t *kpage;
   bool success = false;
 
+#ifdef VM
+  /* The stack page can be evicted like any other, so it goes
+     through the page table too.  Pages below it are added when the
+     process first touches them; see page_add_stack(). */
+  void *upage = ((uint8_t *) PHYS_BASE) - PGSIZE;
+  success = page_add_zero (upage, true) && page_load (upage);
+  if (success)
+    *esp = PHYS_BASE;
+#else
+  uint8_t *kpage;
+
   kpage = palloc_get_page (PAL_USER | PAL_ZERO);
   if (kpage != NULL) 
     {
@@ -866,6 +1013,7 @@ setup_stack (void **esp, const char *file_name, char **save_ptr)
       else
         palloc_free_page (kpage);
     }
+#endif
 
  //printf ("\nInitial : %x : %c %d \n",esp, *esp, *esp);
   
@@ -964,6 +1112,7 @@ setup_stack (void **esp, const char *file_name, char **save_ptr)
 
 
 
+#ifndef VM
 /* Adds a mapping from user virtual address UPAGE to kernel
    virtual address KPAGE to the page table.
    If WRITABLE is true, the user process may modify the page;
@@ -983,3 +1132,4 @@ install_page (void *upage, void *kpage, bool writable)
   return (pagedir_get_page (t->pagedir, upage) == NULL
           && pagedir_set_page (t->pagedir, upage, kpage, writable));
 }
+#endif
@@ -1,91 +1,132 @@
 #include "userprog/syscall.h"
 #include <stdio.h>
+#include <string.h>
 #include <syscall-nr.h>
 #include <user/syscall.h>
 #include "threads/interrupt.h"
+#include "threads/malloc.h"
 #include "threads/thread.h"
 #include "threads/vaddr.h"
+#include "filesys/directory.h"
 #include "filesys/file.h"
 #include "filesys/filesys.h"
 #include "filesys/inode.h"
 #include "userprog/pagedir.h"
 #include "userprog/process.h"
+#include "userprog/usercopy.h"
+#ifdef VM
+#include "vm/mmap.h"
+#include "vm/page.h"
+#endif
 
 static void syscall_handler (struct intr_frame *);
-struct lock file_lock; //lock for handing file sys
+/* The file system locks what it shares internally, so the file
+   system calls below call straight into it, and processes working
+   on different files don't wait for each other. */
 int user_to_kernel_ptr (const void *vaddr);
 //File structre
 struct file_struct
 {
 	struct file* file; //file pointer
-	int file_desc;     //file discriptor
-	struct list_elem elem;
 	bool isdir;
 	struct dir *dir;
 };
 
+/* Number of slots in a process's descriptor table when it is
+   first allocated.  The table doubles whenever it fills up. */
+#define FD_TABLE_MIN 16
+
 void
 validate_page (const void *addr)
 {
-	void *ptr = pagedir_get_page (thread_current ()->pagedir, addr);
-	if (!ptr)
+	/* Touching the byte also brings in a page that is not resident
+	   yet, where a page directory lookup would miss it. */
+	if (!check_user_range (addr, 1, false))
 	{
 		sys_exit (-1);
 	}
 
 }
 
+/* Returns the open file or directory with descriptor FILE_DESC
+   in the current process, or a null pointer if there is none.
+   Descriptors index straight into the process's table, so this
+   takes constant time however many files are open. */
+struct file_struct*
+get_file_struct_handle (int file_desc)
+{
+   struct thread *t = thread_current ();
+
+   if (file_desc < 0 || file_desc >= t->fd_table_size)
+     return NULL;
+   return t->fd_table[file_desc];
+}
+
+/* Returns the open file with descriptor FILE_DESC in the current
+   process, or a null pointer if there is none or it is a
+   directory. */
 struct file*
 get_file_handle (int file_desc)
 {
-	//printf("file handle 1\n");
-   struct list_elem *e = list_begin (&thread_current()->files_owned_list);
-   struct list_elem *next;
-   while (e != list_end (&thread_current()->files_owned_list))
-   {
-
-     struct file_struct *f = list_entry (e, struct file_struct,
-                                          elem);
-     next = list_next(e);
-     if (file_desc == f->file_desc)
-       {
-       //	printf("file handle 2\n");
-        return f->file;
-       }
-     e = next;
-   }
-   return NULL;
+   struct file_struct *f = get_file_struct_handle (file_desc);
 
+   if (f == NULL || f->isdir)
+     return NULL;
+   return f->file;
 }
-//get file struct
-struct file_struct*
-get_file_struct_handle (int file_desc)
-{
-	//printf("file handle 1\n");
-   struct list_elem *e = list_begin (&thread_current()->files_owned_list);
-   struct list_elem *next;
-   while (e != list_end (&thread_current()->files_owned_list))
-   {
 
-     struct file_struct *f = list_entry (e, struct file_struct,
-                                          elem);
-     next = list_next(e);
-     if (file_desc == f->file_desc)
-       {
-       //	printf("file handle 2\n");
-        return f;
-       }
-     e = next;
-   }
-   return NULL;
+/* Installs F in the current process's descriptor table under the
+   lowest free descriptor, growing the table if it is full, and
+   returns the descriptor, or -1 if out of memory. */
+static int
+fd_alloc (struct file_struct *f)
+{
+   struct thread *t = thread_current ();
+   int fd;
+
+   /* Every descriptor below fd_next is in use. */
+   for (fd = t->fd_next; fd < t->fd_table_size; fd++)
+     if (t->fd_table[fd] == NULL)
+       break;
+   if (fd >= t->fd_table_size)
+     {
+       int size = t->fd_table_size > 0 ? t->fd_table_size * 2 : FD_TABLE_MIN;
+       struct file_struct **table = realloc (t->fd_table,
+                                             size * sizeof *table);
+       if (table == NULL)
+         return -1;
+       memset (table + t->fd_table_size, 0,
+               (size - t->fd_table_size) * sizeof *table);
+       t->fd_table = table;
+       t->fd_table_size = size;
+     }
+   t->fd_table[fd] = f;
+   t->fd_next = fd + 1;
+   return fd;
+}
 
+/* Removes FILE_DESC from the current process's descriptor table
+   and returns the file or directory it referred to, or a null
+   pointer if it was not open. */
+static struct file_struct *
+fd_free (int file_desc)
+{
+   struct thread *t = thread_current ();
+   struct file_struct *f = get_file_struct_handle (file_desc);
+
+   if (f != NULL)
+     {
+       t->fd_table[file_desc] = NULL;
+       if (file_desc < t->fd_next)
+         t->fd_next = file_desc;
+     }
+   return f;
 }
 
 void
 syscall_init (void) 
 {
 	//("System call init...\n");
-	lock_init (&file_lock);
   	intr_register_int (0x30, 3, INTR_ON, syscall_handler, "syscall");
 }
 
@@ -118,15 +159,14 @@ sys_exit (int status)
 void
 sys_close (int file_desc)
 {
-	struct file_struct *file_ptr = get_file_handle (file_desc);
+	struct file_struct *file_ptr = fd_free (file_desc);
 	if (file_ptr != NULL)
 		 {
-		 	if (file_desc == file_ptr->file_desc)
-		 	{
+		 	if (file_ptr->isdir)
+		 		dir_close (file_ptr->dir);
+		 	else
 		 		file_close (file_ptr->file);
-		 		list_remove (&file_ptr->elem);
-		 		free (file_ptr);
-		 	}	
+		 	free (file_ptr);
 		 }
 	
 
@@ -151,53 +191,54 @@ sys_tell (int file_desc)
 void
 sys_seek (int file_desc, unsigned offset)
 {
-	lock_acquire (&file_lock);
 	struct file_struct *file_ptr = get_file_struct_handle (file_desc); 
         if (!file_ptr)
         {
-	   lock_release(&file_lock);
             return;
         }
 	if (file_ptr->isdir)
 	{
-	    lock_release (&file_lock);
             return;
 	}
 	file_seek (file_ptr->file, offset);	
-	lock_release (&file_lock);
 }
 
 int
 sys_read (int file_desc, char *buf, unsigned s)
 {
-	validate_ptr (buf);
-	validate_page (buf);
-	//printf("Validaion passed..\n");
+	/* Check the whole buffer up front, so the file system can
+	   copy straight from the buffer cache into it. */
+	if (!check_user_range (buf, s, true))
+		sys_exit (-1);
      
 	if (file_desc == STDIN_FILENO)
 		 {
 		 	//read from buffer
-		 	int i;
+		 	unsigned i;
 		 	for (i = 0; i < s; i++)
-		 		 {
 		 		 	*(buf++) = input_getc();
-		 		 	return s; 
-		 		 }
+		 	return s; 
 		 }
-        lock_acquire (&file_lock);	
 	struct file_struct* file_ptr = get_file_struct_handle (file_desc);
 	if (file_ptr == NULL)
 	{
-		lock_release (&file_lock);
 		return -1;
 	}
         if (file_ptr->isdir){
-               lock_release (&file_lock);
 		return -1;
         }
 	//printf("Got Fd...\n");
+#ifdef VM
+	/* A page fault while the file system holds its locks could
+	   need them again to bring the page in, so keep the buffer
+	   resident until the copy is done. */
+	if (!page_pin_range (buf, s))
+		sys_exit (-1);
+#endif
 	off_t bytes_read = file_read (file_ptr->file, buf, s);
-	lock_release (&file_lock);
+#ifdef VM
+	page_unpin_range (buf, s);
+#endif
 	return bytes_read;
 
 }
@@ -205,19 +246,17 @@ sys_read (int file_desc, char *buf, unsigned s)
 int
 sys_filesize (int file_desc)
 {
-	lock_acquire (&file_lock);	
 	struct file *file_ptr = get_file_handle (file_desc);
+	if (file_ptr == NULL)
+		return -1;
 	int file_size = file_length (file_ptr);
-	lock_release (&file_lock);
 	return file_size;
 }
 
 bool
 sys_remove (const char *file)
 {
-	lock_acquire (&file_lock);
 	bool status = filesys_remove (file);
-	lock_release (&file_lock);
 	return status;	
 }
 
@@ -230,9 +269,7 @@ sys_create (const char *file, unsigned size)
 		 }
 	validate_ptr (file);
 	validate_page (file);
-	lock_acquire (&file_lock);
 	bool status = filesys_create (file, size, false);
-	lock_release (&file_lock);
 	return status;
 }
 
@@ -282,13 +319,11 @@ sys_open (const char *file)
 		 }
 	validate_ptr (file);	 
 	validate_page (file);	 
-	lock_acquire (&file_lock);
 	struct file *handle = filesys_open (file);
 
 	if (handle == NULL)
 		 {
 	//	 	printf("handle null...\n");
-		 	lock_release (&file_lock);
 		 	//sys_exit(-1);
 		 	return -1;
 		 }
@@ -297,13 +332,9 @@ sys_open (const char *file)
 	if (file_ptr == NULL)
 		 {
 	//	 	printf("no memory allocated..\n");
-		 	lock_release (&file_lock);
 		 	return -1;
 		 }
         
-	file_ptr->file_desc = thread_current ()->file_desc;
-	//so that on opening twice it gives diff fd
-	thread_current ()->file_desc++; 
    /*
     * Based on the different file type.
     *
@@ -316,21 +347,27 @@ sys_open (const char *file)
 	   file_ptr->isdir = false;
        }	
 
-	list_push_back (&thread_current ()->files_owned_list , &file_ptr->elem);
+	int file_desc = fd_alloc (file_ptr);
+	if (file_desc < 0)
+		 {
+		 	if (file_ptr->isdir)
+		 		dir_close (file_ptr->dir);
+		 	else
+		 		file_close (handle);
+		 	free (file_ptr);
+		 	return -1;
+		 }
 	//check for file name with thread name for rox-* tests
 	if (strcmp (file, thread_current ()->name) == 0)
 	 {
 	    	file_deny_write (handle);
 	 }
 
-	lock_release (&file_lock);	 
-
 
 /*
 	
 */
-	//printf("returning %d\n", file_ptr->file_desc);
-	return file_ptr->file_desc;
+	return file_desc;
 }
 
 
@@ -338,8 +375,8 @@ static int
 sys_write (int file_desc, const void *buffer, unsigned size)
 {
 	//printf("write 1\n");
-	validate_ptr (buffer);
-	validate_page (buffer);
+	if (!check_user_range (buffer, size, false))
+		sys_exit (-1);
 	if (file_desc == STDOUT_FILENO)
 	 {
 	 	int left = size;
@@ -355,27 +392,29 @@ sys_write (int file_desc, const void *buffer, unsigned size)
 	 	return size;
 	 }
 
-	 lock_acquire (&file_lock);
 	// struct file *file_ptr = get_file_handle (file_desc);
 	// printf("write 2\n");
-	 //if lock doesn't acquired then return
 	 struct file_struct *file_struct = get_file_struct_handle (file_desc);
          if (file_struct == NULL)
 	 	 {
-	 	 	lock_release (&file_lock);
 	 	 	sys_exit (-1);
 	 	 }
  
 	// printf("write 3\n");	 
          if (file_struct->isdir)
          {
-              lock_release(&file_lock);
 	      sys_exit(-1);
          }
 
+#ifdef VM
+	 if (!page_pin_range (buffer, size))
+	 	 sys_exit (-1);
+#endif
 	 int bytes_wrriten = file_write (file_struct->file, buffer, size);
+#ifdef VM
+	 page_unpin_range (buffer, size);
+#endif
 	// printf("Wrriten to file bytes:%d\n",bytes_wrriten );
-	 lock_release (&file_lock);
 	 return bytes_wrriten;	 
 }
 
@@ -407,6 +446,7 @@ bool
 readdir (int fd, char *name)
 {
     struct file_struct* file_struct = get_file_struct_handle (fd);
+    char entry[READDIR_MAX_LEN + 1];
     if (!file_struct)
     {
  	return false;
@@ -415,9 +455,11 @@ readdir (int fd, char *name)
     {
         return false;
     }
-    if (!dir_readdir (file_struct->dir, name)){
+    if (!dir_readdir (file_struct->dir, entry)){
         return false;
     }
+    if (!copy_to_user (name, entry, strlen (entry) + 1))
+        sys_exit (-1);
     return true;
 }
 
@@ -455,6 +497,19 @@ inumber (int fd)
   return number;
 }
 
+#ifdef VM
+/* Maps the file open as FILE_DESC at ADDR. */
+static int
+sys_mmap (int file_desc, void *addr)
+{
+   struct file_struct *file_struct = get_file_struct_handle (file_desc);
+
+   if (file_struct == NULL || file_struct->isdir)
+     return -1;
+   return mmap_map (file_struct->file, addr);
+}
+#endif
+
 static void
 syscall_handler (struct intr_frame *f UNUSED) 
 {
@@ -462,14 +517,20 @@ syscall_handler (struct intr_frame *f UNUSED)
 	//printf("%x\n", * ( int *) f->esp);
 	int arg[3];  //maximum 3 args are required by a syscall
 
-	//validates the pointer
-	validate_ptr((const void *) f->esp);
-	validate_page((const void *) f->esp);
-	
-	
+	int nr;
+
+#ifdef VM
+	/* A page fault in the kernel needs this to tell whether the
+	   user stack should grow. */
+	thread_current ()->user_esp = f->esp;
+#endif
+
+	//fetch the system call number
+	if (!copy_from_user (&nr, f->esp, sizeof nr))
+		sys_exit (-1);
 
 	//switch for diff system calls
-	switch(* ( int *) f->esp)
+	switch(nr)
 	{
 		case SYS_HALT:
 		 {
@@ -570,7 +631,6 @@ syscall_handler (struct intr_frame *f UNUSED)
 		case SYS_READDIR:
 		 {
 		       get_arguments_from_stack (f, &arg[0], 2);
-		       arg[1] = user_to_kernel_ptr((const void *)arg[1]);
 		       f->eax = readdir (arg[0], (char *)arg[1]);
 			break;
 		 }
@@ -586,6 +646,25 @@ syscall_handler (struct intr_frame *f UNUSED)
  		     f->eax = inumber (arg[0]);
  		    break;	
 		 }
+#ifdef VM
+		case SYS_MMAP:
+		 {
+		 	get_arguments_from_stack (f, &arg[0], 2);
+		 	f->eax = sys_mmap (arg[0], (void *) arg[1]);
+		 	break;
+		 }
+		case SYS_MUNMAP:
+		 {
+		 	get_arguments_from_stack (f, &arg[0], 1);
+		 	mmap_unmap (arg[0]);
+		 	break;
+		 }
+#endif
+		case SYS_FORK:
+		 {
+		 	f->eax = process_fork (f);
+		 	break;
+		 }
 	}
   
 }
@@ -594,17 +673,8 @@ syscall_handler (struct intr_frame *f UNUSED)
 void
 get_arguments_from_stack (struct intr_frame *f, int *arg, int n)
 {
-	int i;
-	
-	for(i = 0; i < n; ++i)
-		 {
-
-		 	int *ptr = (int *)f->esp + i + 1;
-		 	
-		 	validate_ptr((const void *)ptr);
-		 	arg[i] = *ptr;
-		 //	printf("Arg[%d] :%s\n",i, &arg[i] );
-		 }
+	if (!copy_from_user (arg, (int *) f->esp + 1, n * sizeof *arg))
+		sys_exit (-1);
 }
 
 
@@ -641,6 +711,7 @@ int
 user_to_kernel_ptr (const void *vaddr)
 {
    validate_ptr (vaddr);
+   validate_page (vaddr);
    void *ptr = pagedir_get_page (thread_current ()->pagedir, vaddr);
    if (!ptr)
    {
@@ -649,26 +720,86 @@ user_to_kernel_ptr (const void *vaddr)
     return (int) ptr;
 }
 
+/* Closes every file and directory the current process has open
+   and frees its descriptor table. */
 void
 close_all_files (void)
 {
-   struct list_elem *el = list_begin (&thread_current()->files_owned_list);
-   struct list_elem *nxt;
-   while (el != list_end (&thread_current()->files_owned_list))
-   {
-     struct file_struct *fs = list_entry (el, struct file_struct,
-                                          elem);
-     nxt = list_next(el);
-     if (fs->isdir){
-         dir_close(fs->dir);
-     }
-     else{
-        file_close (fs->file);
+   struct thread *t = thread_current ();
+   int fd;
+
+   for (fd = 0; fd < t->fd_table_size; fd++)
+     {
+       struct file_struct *fs = t->fd_table[fd];
+       if (fs == NULL)
+         continue;
+       if (fs->isdir){
+           dir_close(fs->dir);
+       }
+       else{
+          file_close (fs->file);
+       }
+       free (fs);
      }
-     list_remove (&fs->elem);
-     free (fs);
-     el = nxt;
-   }
+   free (t->fd_table);
+   t->fd_table = NULL;
+   t->fd_table_size = 0;
+   t->fd_next = 2;
 }
 
-
+/* Gives the current process, which is being created by fork(), a
+   copy of PARENT's descriptor table, with every file and directory
+   open in PARENT reopened under the same descriptor, positioned
+   where PARENT's is, and denying writes if PARENT's does.  Returns true if successful,
+   false on out of memory, in which case close_all_files() frees
+   whatever was copied. */
+bool
+copy_all_files (struct thread *parent)
+{
+   struct thread *t = thread_current ();
+   int fd;
+
+   if (parent->fd_table_size == 0)
+     return true;
+   t->fd_table = calloc (parent->fd_table_size, sizeof *t->fd_table);
+   if (t->fd_table == NULL)
+     return false;
+   t->fd_table_size = parent->fd_table_size;
+   t->fd_next = parent->fd_next;
+
+   for (fd = 0; fd < parent->fd_table_size; fd++)
+     {
+       struct file_struct *pfs = parent->fd_table[fd];
+       struct file_struct *fs;
+
+       if (pfs == NULL)
+         continue;
+       fs = malloc (sizeof *fs);
+       if (fs == NULL)
+         return false;
+       fs->isdir = pfs->isdir;
+       if (fs->isdir)
+         {
+           fs->dir = dir_reopen (pfs->dir);
+           if (fs->dir != NULL)
+             dir_seek (fs->dir, dir_tell (pfs->dir));
+         }
+       else
+         {
+           fs->file = file_reopen (pfs->file);
+           if (fs->file != NULL)
+             {
+               file_seek (fs->file, file_tell (pfs->file));
+               if (file_write_denied (pfs->file))
+                 file_deny_write (fs->file);
+             }
+         }
+       if (fs->isdir ? fs->dir == NULL : fs->file == NULL)
+         {
+           free (fs);
+           return false;
+         }
+       t->fd_table[fd] = fs;
+     }
+   return true;
+}
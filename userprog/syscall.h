@@ -7,6 +7,10 @@
 #define LOAD_SUCCESS 1
 #define LOAD_FAIL 2
 
+struct thread;
+
 void syscall_init (void);
+void close_all_files (void);
+bool copy_all_files (struct thread *parent);
 
 #endif /* userprog/syscall.h */
@@ -0,0 +1,70 @@
+#include "userprog/usercopy.h"
+#include <stdint.h>
+#include "threads/vaddr.h"
+
+/* Access to user memory from system calls.
+
+   Instead of looking every user page up in the page directory
+   before touching it, these functions just access user memory and
+   let the MMU check it.  If the access faults, page_fault()
+   notices that the faulting instruction is the one in usercopy()
+   and makes usercopy() return early, so a bad pointer costs a
+   page fault while a good one costs nothing beyond the copy
+   itself.  We only have to check that the range lies below
+   PHYS_BASE, because the kernel can read and write its own
+   memory without faulting. */
+
+/* Returns true if the SIZE bytes starting at UADDR all lie in
+   user virtual memory. */
+static bool
+is_user_range (const void *uaddr, size_t size)
+{
+  uintptr_t start = (uintptr_t) uaddr;
+  uintptr_t end = start + size;
+
+  return end >= start && end <= (uintptr_t) PHYS_BASE;
+}
+
+/* Copies SIZE bytes from user address USRC to kernel buffer DST.
+   Returns true if successful, false if any byte of the source is
+   not mapped in user memory. */
+bool
+copy_from_user (void *dst, const void *usrc, size_t size)
+{
+  return is_user_range (usrc, size) && usercopy (dst, usrc, size) == 0;
+}
+
+/* Copies SIZE bytes from kernel buffer SRC to user address UDST.
+   Returns true if successful, false if any byte of the
+   destination is not mapped writable in user memory. */
+bool
+copy_to_user (void *udst, const void *src, size_t size)
+{
+  return is_user_range (udst, size) && usercopy (udst, src, size) == 0;
+}
+
+/* Returns true if the SIZE bytes starting at user address UADDR
+   are all mapped, and writable too if WRITE is true.  Touches one
+   byte in every page of the range, so afterward the kernel may
+   access the whole range directly, e.g. to copy file data straight
+   between the buffer cache and the user's buffer. */
+bool
+check_user_range (const void *uaddr, size_t size, bool write)
+{
+  const uint8_t *p = uaddr;
+  const uint8_t *end = p + size;
+  uint8_t byte;
+
+  if (!is_user_range (uaddr, size))
+    return false;
+  while (p < end)
+    {
+      /* Writing back the byte just read leaves the page unchanged,
+         since the process is blocked in the system call. */
+      if (usercopy (&byte, p, 1) != 0
+          || (write && usercopy ((uint8_t *) p, &byte, 1) != 0))
+        return false;
+      p = (const uint8_t *) pg_round_down (p) + PGSIZE;
+    }
+  return true;
+}
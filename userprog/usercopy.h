@@ -0,0 +1,17 @@
+#ifndef USERPROG_USERCOPY_H
+#define USERPROG_USERCOPY_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/* Copy routine and the addresses page_fault() uses to recover
+   from a fault inside it.  See usercopy-stub.S. */
+size_t usercopy (void *dst, const void *src, size_t size);
+void usercopy_insn (void);
+void usercopy_fixup (void);
+
+bool copy_from_user (void *dst, const void *usrc, size_t size);
+bool copy_to_user (void *udst, const void *src, size_t size);
+bool check_user_range (const void *uaddr, size_t size, bool write);
+
+#endif /* userprog/usercopy.h */
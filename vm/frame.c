@@ -0,0 +1,164 @@
+#include "vm/frame.h"
+#include <debug.h>
+#include <stdio.h>
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/thread.h"
+#include "userprog/pagedir.h"
+#include "vm/page.h"
+#include "vm/share.h"
+
+/*
+ * The frame table records every frame of the user pool that holds
+ * a page, and which page of which process it holds.  When the user
+ * pool runs dry, a frame is taken from some page with the clock
+ * algorithm: the hand sweeps the table in order, giving each frame
+ * whose page was accessed since the last sweep a second chance by
+ * clearing its accessed bit, and evicts the first page it finds
+ * unaccessed.  page_evict() saves the page's contents, if needed.
+ * A shared frame counts as accessed if any process that maps it
+ * accessed it, and evicting it unmaps it from all of them.
+ */
+
+struct lock frame_lock;
+struct condition frame_evicted;
+
+static struct list frames;              /* All frames in use. */
+static struct list_elem *hand;          /* Next frame the clock examines. */
+static size_t frame_cnt;
+static unsigned long long evictions;
+
+static struct frame *frame_evict (void);
+static struct frame *clock_next (void);
+static bool frame_accessed (struct frame *);
+
+/* Initializes the frame table. */
+void
+frame_init (void)
+{
+  lock_init (&frame_lock);
+  cond_init (&frame_evicted);
+  list_init (&frames);
+  hand = list_end (&frames);
+}
+
+/* Prints frame table statistics. */
+void
+frame_print_stats (void)
+{
+  printf ("Frames: %zu in use, %llu evictions\n", frame_cnt, evictions);
+}
+
+/* Returns a pinned frame for page P of the current process, or
+   for a shared page if P is null, taken from the user pool or, if
+   that is empty, from the page that the clock algorithm evicts.
+   Returns a null pointer if every frame is pinned or no page can
+   be evicted. */
+struct frame *
+frame_alloc (struct page *p)
+{
+  struct frame *f = NULL;
+  void *kpage;
+
+  lock_acquire (&frame_lock);
+  kpage = palloc_get_page (PAL_USER);
+  if (kpage != NULL)
+    {
+      f = malloc (sizeof *f);
+      if (f == NULL)
+        palloc_free_page (kpage);
+      else
+        {
+          f->kpage = kpage;
+          list_push_back (&frames, &f->elem);
+          frame_cnt++;
+        }
+    }
+  else
+    f = frame_evict ();
+
+  if (f != NULL)
+    {
+      f->page = p;
+      f->owner = thread_current ();
+      f->share = NULL;
+      f->pin_cnt = 1;
+    }
+  lock_release (&frame_lock);
+  return f;
+}
+
+/* Removes F from the frame table and returns it to the user pool.
+   Its page must already be unmapped.  The caller must hold
+   frame_lock. */
+void
+frame_free (struct frame *f)
+{
+  ASSERT (lock_held_by_current_thread (&frame_lock));
+
+  if (hand == &f->elem)
+    hand = list_next (hand);
+  list_remove (&f->elem);
+  frame_cnt--;
+  palloc_free_page (f->kpage);
+  free (f);
+}
+
+/* Runs the clock hand until it finds an unpinned frame whose page
+   was not accessed recently, evicts that page, and returns the
+   frame, pinned.  Two sweeps clear every accessed bit, so if they
+   find nothing, every frame is pinned and we return a null
+   pointer. */
+static struct frame *
+frame_evict (void)
+{
+  size_t i;
+
+  for (i = 0; i < 2 * frame_cnt; i++)
+    {
+      struct frame *f = clock_next ();
+
+      if (f->pin_cnt > 0 || frame_accessed (f))
+        continue;
+
+      f->pin_cnt = 1;
+      evictions++;
+      if (f->share != NULL)
+        share_evict (f->share);
+      else
+        page_evict (f->page, f->owner);
+      return f;
+    }
+  return NULL;
+}
+
+/* Returns true if the page in F was accessed since the last call,
+   and clears its accessed bits. */
+static bool
+frame_accessed (struct frame *f)
+{
+  uint32_t *pd;
+
+  if (f->share != NULL)
+    return share_accessed (f->share);
+
+  pd = f->owner->pagedir;
+  if (!pagedir_is_accessed (pd, f->page->upage))
+    return false;
+  pagedir_set_accessed (pd, f->page->upage, false);
+  return true;
+}
+
+/* Returns the frame under the clock hand and advances the hand,
+   wrapping around at the end of the table. */
+static struct frame *
+clock_next (void)
+{
+  struct frame *f;
+
+  if (hand == list_end (&frames))
+    hand = list_begin (&frames);
+  f = list_entry (hand, struct frame, elem);
+  hand = list_next (hand);
+  return f;
+}
@@ -0,0 +1,38 @@
+#ifndef VM_FRAME_H
+#define VM_FRAME_H
+
+#include <list.h>
+#include <stdbool.h>
+#include "threads/synch.h"
+
+struct page;
+struct share;
+struct thread;
+
+/* A frame of user memory holding either a page of one process or
+   a read-only page shared by several (see vm/share.c). */
+struct frame
+  {
+    void *kpage;                        /* Kernel address of the frame. */
+    struct page *page;                  /* Private page it holds... */
+    struct thread *owner;               /* ...in this process. */
+    struct share *share;                /* Shared page it holds. */
+    unsigned pin_cnt;                   /* Never evicted while nonzero. */
+    struct list_elem elem;              /* Element in frame table. */
+  };
+
+/* Protects the frame table and the links between pages and
+   frames.  Never held across I/O. */
+extern struct lock frame_lock;
+
+/* Signaled under frame_lock whenever a page finishes eviction
+   or a shared page finishes loading. */
+extern struct condition frame_evicted;
+
+void frame_init (void);
+void frame_print_stats (void);
+
+struct frame *frame_alloc (struct page *);
+void frame_free (struct frame *);
+
+#endif /* vm/frame.h */
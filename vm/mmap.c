@@ -0,0 +1,141 @@
+#include "vm/mmap.h"
+#include <debug.h>
+#include <list.h>
+#include <round.h>
+#include <stdint.h>
+#include "filesys/file.h"
+#include "threads/malloc.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#include "vm/page.h"
+
+/*
+ * Memory-mapped files.  A mapping only enters its pages into the
+ * supplemental page table as PAGE_MMAP pages, so they are read
+ * through the buffer cache when first touched, and written back
+ * only if dirty, when evicted or unmapped.  Each mapping holds its
+ * own reference to the file, so it outlives the descriptor it was
+ * made from.
+ */
+struct mapping
+  {
+    int id;                             /* Mapping identifier. */
+    struct file *file;                  /* File mapped. */
+    uint8_t *base;                      /* First user page. */
+    size_t page_cnt;                    /* Number of pages. */
+    struct list_elem elem;              /* Element in thread's mappings. */
+  };
+
+static struct mapping *mapping_find (int mapid);
+static void mapping_remove (struct mapping *, size_t page_cnt);
+
+/* Maps FILE into the current process's address space starting at
+   ADDR and returns the mapping's identifier, or -1 if FILE is
+   empty, ADDR is null or not page-aligned, or the mapping would
+   overlap a page that is already in use. */
+int
+mmap_map (struct file *file, void *addr)
+{
+  struct thread *t = thread_current ();
+  struct mapping *m;
+  off_t length = file_length (file);
+  size_t page_cnt = DIV_ROUND_UP (length, PGSIZE);
+  uintptr_t start = (uintptr_t) addr;
+  size_t i;
+
+  if (addr == NULL || pg_ofs (addr) != 0 || length == 0
+      || start + page_cnt * PGSIZE < start
+      || start + page_cnt * PGSIZE > (uintptr_t) PHYS_BASE)
+    return -1;
+  for (i = 0; i < page_cnt; i++)
+    if (page_lookup ((uint8_t *) addr + i * PGSIZE) != NULL)
+      return -1;
+
+  m = malloc (sizeof *m);
+  if (m == NULL)
+    return -1;
+  m->file = file_reopen (file);
+  if (m->file == NULL)
+    {
+      free (m);
+      return -1;
+    }
+  m->base = addr;
+  m->page_cnt = page_cnt;
+
+  for (i = 0; i < page_cnt; i++)
+    {
+      off_t ofs = i * PGSIZE;
+      size_t read_bytes = length - ofs < PGSIZE ? length - ofs : PGSIZE;
+
+      if (!page_add_mmap (m->base + ofs, m->file, ofs, read_bytes))
+        {
+          mapping_remove (m, i);
+          return -1;
+        }
+    }
+
+  m->id = t->next_mapid++;
+  list_push_back (&t->mappings, &m->elem);
+  return m->id;
+}
+
+/* Unmaps the current process's mapping MAPID, writing back the
+   pages that were changed.  Returns false if there is no such
+   mapping. */
+bool
+mmap_unmap (int mapid)
+{
+  struct mapping *m = mapping_find (mapid);
+
+  if (m == NULL)
+    return false;
+  list_remove (&m->elem);
+  mapping_remove (m, m->page_cnt);
+  return true;
+}
+
+/* Unmaps all of the current process's mappings. */
+void
+mmap_unmap_all (void)
+{
+  struct thread *t = thread_current ();
+
+  while (!list_empty (&t->mappings))
+    {
+      struct mapping *m = list_entry (list_pop_front (&t->mappings),
+                                      struct mapping, elem);
+      mapping_remove (m, m->page_cnt);
+    }
+}
+
+/* Returns the current process's mapping MAPID, or a null pointer
+   if there is none. */
+static struct mapping *
+mapping_find (int mapid)
+{
+  struct thread *t = thread_current ();
+  struct list_elem *e;
+
+  for (e = list_begin (&t->mappings); e != list_end (&t->mappings);
+       e = list_next (e))
+    {
+      struct mapping *m = list_entry (e, struct mapping, elem);
+      if (m->id == mapid)
+        return m;
+    }
+  return NULL;
+}
+
+/* Removes the first PAGE_CNT pages of M from the page table,
+   closes its file, and frees M. */
+static void
+mapping_remove (struct mapping *m, size_t page_cnt)
+{
+  size_t i;
+
+  for (i = 0; i < page_cnt; i++)
+    page_remove (m->base + i * PGSIZE);
+  file_close (m->file);
+  free (m);
+}
@@ -0,0 +1,562 @@
+#include "vm/page.h"
+#include <debug.h>
+#include <string.h>
+#include "filesys/file.h"
+#include "threads/malloc.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#include "userprog/pagedir.h"
+#include "vm/frame.h"
+#include "vm/share.h"
+#include "vm/swap.h"
+
+/*
+ * Demand paging.  Loading an executable only records in the
+ * process's supplemental page table where each page of it comes
+ * from, and no memory is allocated or read until the process
+ * touches the page.  The page fault that follows calls
+ * page_load(), which gets a frame, fills it from the file, with
+ * zeros, or from swap, and maps it.
+ *
+ * Only the process itself adds, looks up, and removes entries of
+ * its page table, so the table needs no lock.  The evictor in
+ * vm/frame.c may take the frame of any process's page, though, so
+ * a page's frame and evicting fields are protected by frame_lock.
+ * While a page is being written out, its owner waits for that to
+ * finish before bringing it back in or freeing it.
+ *
+ * A page that was ever written goes to swap when evicted.  Other
+ * pages are dropped, and read again from their file or zeroed when
+ * they come back.  A page brought back from swap no longer has a
+ * copy there, so it goes to swap again the next time.  Pages of a
+ * memory-mapped file are backed by the file itself instead: they
+ * are written back to it, through the buffer cache, only if their
+ * dirty bit is set when they are evicted or unmapped.
+ *
+ * Read-only pages of an executable are shared by every process
+ * running it through vm/share.c, which then owns their frames.
+ * So are the writable pages of a process and its children created
+ * by fork(), until one of them writes the page.
+ */
+
+static unsigned page_hash (const struct hash_elem *, void *);
+static bool page_less (const struct hash_elem *, const struct hash_elem *,
+                       void *);
+static bool page_add (struct page *);
+static void page_free (struct hash_elem *, void *);
+static bool page_in (struct page *, bool pin);
+static bool page_pin (const void *addr);
+static void page_wait (struct page *);
+static void page_discard (struct page *);
+static bool page_copy (struct page *, struct file *exec_file);
+
+/* Creates an empty supplemental page table for the current
+   process.  Returns true if successful, false on out of memory. */
+bool
+page_table_create (void)
+{
+  struct thread *t = thread_current ();
+
+  ASSERT (t->pages == NULL);
+  t->pages = malloc (sizeof *t->pages);
+  if (t->pages == NULL)
+    return false;
+  if (!hash_init (t->pages, page_hash, page_less, NULL))
+    {
+      free (t->pages);
+      t->pages = NULL;
+      return false;
+    }
+  return true;
+}
+
+/* Gives the current process, which is being created by fork(), a
+   copy of the page table of PARENT, which is blocked until we are
+   done.  Pages that PARENT has in memory or in swap and may write
+   become copy-on-write pages shared by both processes.  The copies
+   of PARENT's executable pages refer to EXEC_FILE instead of
+   PARENT's executable.  Memory-mapped files are not inherited.
+   Returns true if successful, false on out of memory. */
+bool
+page_table_copy (struct thread *parent, struct file *exec_file)
+{
+  struct hash_iterator i;
+
+  hash_first (&i, parent->pages);
+  while (hash_next (&i))
+    {
+      struct page *p = hash_entry (hash_cur (&i), struct page, hash_elem);
+
+      if (p->type != PAGE_MMAP && !page_copy (p, exec_file))
+        return false;
+    }
+  return true;
+}
+
+/* Destroys the current process's supplemental page table, if it
+   has one, unmapping and freeing its frames and swap slots.  Must
+   be called before the page directory is destroyed. */
+void
+page_table_destroy (void)
+{
+  struct thread *t = thread_current ();
+
+  if (t->pages != NULL)
+    {
+      hash_destroy (t->pages, page_free);
+      free (t->pages);
+      t->pages = NULL;
+    }
+}
+
+/* Adds a page at UPAGE whose first READ_BYTES bytes are read from
+   FILE starting at OFS, and whose remaining bytes are zero.  The
+   user may write the page if WRITABLE is true.  FILE must stay
+   open as long as the page exists.  Returns true if successful,
+   false if UPAGE is already in the table or on out of memory. */
+bool
+page_add_file (void *upage, struct file *file, off_t ofs,
+               size_t read_bytes, bool writable)
+{
+  struct page *p;
+
+  ASSERT (read_bytes <= PGSIZE);
+
+  if (read_bytes == 0)
+    return page_add_zero (upage, writable);
+
+  p = malloc (sizeof *p);
+  if (p == NULL)
+    return false;
+  p->upage = upage;
+  p->type = PAGE_FILE;
+  p->writable = writable;
+  p->file = file;
+  p->ofs = ofs;
+  p->read_bytes = read_bytes;
+  if (!page_add (p))
+    return false;
+  if (!writable)
+    share_attach (p);
+  return true;
+}
+
+/* Adds an all-zero page at UPAGE, which the user may write if
+   WRITABLE is true.  Returns true if successful, false if UPAGE
+   is already in the table or on out of memory. */
+bool
+page_add_zero (void *upage, bool writable)
+{
+  struct page *p = malloc (sizeof *p);
+
+  if (p == NULL)
+    return false;
+  p->upage = upage;
+  p->type = PAGE_ZERO;
+  p->writable = writable;
+  p->file = NULL;
+  p->ofs = 0;
+  p->read_bytes = 0;
+  return page_add (p);
+}
+
+/* Adds a writable all-zero page at user address ADDR if ADDR looks
+   like an access to the stack of a process whose stack pointer is
+   ESP: within STACK_MAX of the top of user memory, and at most 32
+   bytes below ESP, as far down as PUSHA writes before it moves ESP.
+   Returns true if successful, false if ADDR is not a stack access,
+   is already in the table, or on out of memory. */
+bool
+page_add_stack (const void *addr, const void *esp)
+{
+  const uint8_t *a = addr;
+
+  if (esp == NULL || !is_user_vaddr (addr)
+      || a < (uint8_t *) PHYS_BASE - STACK_MAX
+      || a < (const uint8_t *) esp - 32)
+    return false;
+  return page_add_zero (pg_round_down (addr), true);
+}
+
+/* Adds a page at UPAGE that maps the READ_BYTES bytes of FILE
+   starting at OFS, followed by zeros.  The page is writable, and
+   changes to it are written back to FILE.  FILE must stay open as
+   long as the page exists.  Returns true if successful, false if
+   UPAGE is already in the table or on out of memory. */
+bool
+page_add_mmap (void *upage, struct file *file, off_t ofs,
+               size_t read_bytes)
+{
+  struct page *p;
+
+  ASSERT (read_bytes > 0 && read_bytes <= PGSIZE);
+
+  p = malloc (sizeof *p);
+  if (p == NULL)
+    return false;
+  p->upage = upage;
+  p->type = PAGE_MMAP;
+  p->writable = true;
+  p->file = file;
+  p->ofs = ofs;
+  p->read_bytes = read_bytes;
+  return page_add (p);
+}
+
+/* Removes the current process's page at UPAGE, which must exist,
+   writing it back first if it is a dirty page of a mapped file. */
+void
+page_remove (void *upage)
+{
+  struct page *p = page_lookup (upage);
+
+  ASSERT (p != NULL);
+  hash_delete (thread_current ()->pages, &p->hash_elem);
+  page_discard (p);
+}
+
+/* Returns the current process's page at UPAGE, or a null pointer
+   if there is none. */
+struct page *
+page_lookup (const void *upage)
+{
+  struct thread *t = thread_current ();
+  struct page key;
+  struct hash_elem *e;
+
+  if (t->pages == NULL)
+    return NULL;
+  key.upage = pg_round_down (upage);
+  e = hash_find (t->pages, &key.hash_elem);
+  return e != NULL ? hash_entry (e, struct page, hash_elem) : NULL;
+}
+
+/* Brings in the page containing user address ADDR, which is not
+   resident, and maps it.  Returns true if successful, false if
+   ADDR is not in the process's address space, or if no frame can
+   be had or the page cannot be read. */
+bool
+page_load (const void *addr)
+{
+  struct page *p = page_lookup (addr);
+  bool resident;
+
+  if (p == NULL)
+    return false;
+  lock_acquire (&frame_lock);
+  page_wait (p);
+  resident = p->frame != NULL;
+  lock_release (&frame_lock);
+  return !resident && page_in (p, false);
+}
+
+/* Gives the current process a private copy of the copy-on-write
+   page containing user address ADDR, which the process just tried
+   to write, and maps it writable.  Returns true if successful,
+   false if ADDR is not in such a page or no frame can be had. */
+bool
+page_copy_on_write (const void *addr)
+{
+  struct page *p = page_lookup (addr);
+
+  if (p == NULL || !p->writable || p->share == NULL)
+    return false;
+  return share_write (p);
+}
+
+/* Brings in every page of the SIZE bytes at user address UADDR and
+   pins them, so that they stay resident until unpinned and the
+   kernel may access them without faulting, e.g. while it holds
+   file system locks.  Pages of the stack that the process has not
+   touched yet are added, as a page fault there would.  Returns
+   true if successful, false if some page is not in the process's
+   address space or cannot be brought in, in which case nothing is
+   left pinned. */
+bool
+page_pin_range (const void *uaddr, size_t size)
+{
+  const uint8_t *start = pg_round_down (uaddr);
+  const uint8_t *end = (const uint8_t *) uaddr + size;
+  const uint8_t *p;
+
+  for (p = start; p < end; p += PGSIZE)
+    if (!page_pin (p < (const uint8_t *) uaddr ? uaddr : p))
+      {
+        page_unpin_range (start, p - start);
+        return false;
+      }
+  return true;
+}
+
+/* Unpins the pages of the SIZE bytes at UADDR, which
+   page_pin_range() pinned. */
+void
+page_unpin_range (const void *uaddr, size_t size)
+{
+  const uint8_t *end = (const uint8_t *) uaddr + size;
+  const uint8_t *p;
+
+  lock_acquire (&frame_lock);
+  for (p = pg_round_down (uaddr); p < end; p += PGSIZE)
+    {
+      struct page *page = page_lookup (p);
+      if (page != NULL && page->frame != NULL)
+        page->frame->pin_cnt--;
+    }
+  lock_release (&frame_lock);
+}
+
+/* Evicts page P of process OWNER from its frame, which the caller
+   has pinned, writing it back to its file if it is a dirty mapped
+   page, or to swap if it was ever written.  The caller must hold
+   frame_lock, which is released during the write. */
+void
+page_evict (struct page *p, struct thread *owner)
+{
+  uint32_t *pd = owner->pagedir;
+  bool dirty;
+
+  ASSERT (lock_held_by_current_thread (&frame_lock));
+  ASSERT (p->frame != NULL && p->frame->pin_cnt > 0);
+
+  /* Unmap the page first, so that the owner cannot dirty it
+     after we look at the dirty bit. */
+  p->evicting = true;
+  pagedir_clear_page (pd, p->upage);
+  dirty = pagedir_is_dirty (pd, p->upage);
+  if (p->type == PAGE_MMAP)
+    {
+      if (dirty)
+        {
+          lock_release (&frame_lock);
+          file_write_at (p->file, p->frame->kpage, p->read_bytes, p->ofs);
+          lock_acquire (&frame_lock);
+        }
+    }
+  else if (dirty || p->type == PAGE_SWAP)
+    {
+      size_t slot;
+
+      lock_release (&frame_lock);
+      slot = swap_out (p->frame->kpage);
+      lock_acquire (&frame_lock);
+      if (slot == SWAP_ERROR)
+        PANIC ("out of swap space");
+      p->type = PAGE_SWAP;
+      p->swap_slot = slot;
+    }
+  p->frame = NULL;
+  p->evicting = false;
+  cond_broadcast (&frame_evicted, &frame_lock);
+}
+
+/* Gets a frame for P, which is not resident, fills it, and maps
+   it.  The frame stays pinned if PIN is true.  Returns true if
+   successful, false if no frame can be had or P cannot be
+   read. */
+static bool
+page_in (struct page *p, bool pin)
+{
+  struct thread *t = thread_current ();
+  struct frame *f;
+  uint8_t *kpage;
+
+  if (p->share != NULL)
+    return share_in (p, pin);
+
+  f = frame_alloc (p);
+  if (f == NULL)
+    return false;
+  kpage = f->kpage;
+
+  switch (p->type)
+    {
+    case PAGE_FILE:
+    case PAGE_MMAP:
+      if (file_read_at (p->file, kpage, p->read_bytes, p->ofs)
+          != (off_t) p->read_bytes)
+        goto fail;
+      memset (kpage + p->read_bytes, 0, PGSIZE - p->read_bytes);
+      break;
+    case PAGE_ZERO:
+      memset (kpage, 0, PGSIZE);
+      break;
+    case PAGE_SWAP:
+      swap_in (p->swap_slot, kpage);
+      p->swap_slot = SWAP_ERROR;
+      break;
+    }
+
+  if (!pagedir_set_page (t->pagedir, p->upage, kpage, p->writable))
+    goto fail;
+  /* The user is about to touch the page, so don't let the clock
+     take it right back. */
+  pagedir_set_accessed (t->pagedir, p->upage, true);
+
+  lock_acquire (&frame_lock);
+  p->frame = f;
+  if (!pin)
+    f->pin_cnt--;
+  lock_release (&frame_lock);
+  return true;
+
+ fail:
+  lock_acquire (&frame_lock);
+  frame_free (f);
+  lock_release (&frame_lock);
+  return false;
+}
+
+/* Pins the page containing user address ADDR, bringing it in
+   first if it is not resident, or adding it if it is a new page of
+   the stack.  Returns true if successful, false if there is no page
+   at ADDR or it cannot be brought in. */
+static bool
+page_pin (const void *addr)
+{
+  struct page *p = page_lookup (addr);
+
+  if (p == NULL && page_add_stack (addr, thread_current ()->user_esp))
+    p = page_lookup (addr);
+  if (p == NULL)
+    return false;
+  lock_acquire (&frame_lock);
+  page_wait (p);
+  if (p->frame != NULL)
+    {
+      p->frame->pin_cnt++;
+      lock_release (&frame_lock);
+      return true;
+    }
+  lock_release (&frame_lock);
+  return page_in (p, true);
+}
+
+/* Waits until P is not being evicted.  The caller must hold
+   frame_lock. */
+static void
+page_wait (struct page *p)
+{
+  while (p->evicting)
+    cond_wait (&frame_evicted, &frame_lock);
+}
+
+/* Inserts P into the current process's page table, or frees it
+   and returns false if its page is already there. */
+static bool
+page_add (struct page *p)
+{
+  struct thread *t = thread_current ();
+
+  ASSERT (pg_ofs (p->upage) == 0);
+
+  p->swap_slot = SWAP_ERROR;
+  p->owner = t;
+  p->frame = NULL;
+  p->evicting = false;
+  p->share = NULL;
+  if (hash_insert (t->pages, &p->hash_elem) != NULL)
+    {
+      free (p);
+      return false;
+    }
+  return true;
+}
+
+/* Adds a copy of P, a page of a process blocked in fork(), to the
+   current process's page table, sharing P's contents with it if P
+   is shared already or has contents of its own.  Returns true if
+   successful, false on out of memory. */
+static bool
+page_copy (struct page *p, struct file *exec_file)
+{
+  struct page *c = malloc (sizeof *c);
+  bool success = true;
+
+  if (c == NULL)
+    return false;
+  c->upage = p->upage;
+  c->type = p->type;
+  c->writable = p->writable;
+  c->file = p->file != NULL ? exec_file : NULL;
+  c->ofs = p->ofs;
+  c->read_bytes = p->read_bytes;
+  if (!page_add (c))
+    return false;
+
+  lock_acquire (&frame_lock);
+  page_wait (p);
+  if (p->share == NULL && p->writable
+      && (p->frame != NULL || p->swap_slot != SWAP_ERROR))
+    success = share_cow (p);
+  if (success && p->share != NULL)
+    share_add (p->share, c);
+  lock_release (&frame_lock);
+  return success;
+}
+
+/* Hashes a page by its user address. */
+static unsigned
+page_hash (const struct hash_elem *e, void *aux UNUSED)
+{
+  const struct page *p = hash_entry (e, struct page, hash_elem);
+  return hash_bytes (&p->upage, sizeof p->upage);
+}
+
+/* Orders pages by user address. */
+static bool
+page_less (const struct hash_elem *a_, const struct hash_elem *b_,
+           void *aux UNUSED)
+{
+  const struct page *a = hash_entry (a_, struct page, hash_elem);
+  const struct page *b = hash_entry (b_, struct page, hash_elem);
+  return a->upage < b->upage;
+}
+
+/* Frees a page of the current process, for hash_destroy(). */
+static void
+page_free (struct hash_elem *e, void *aux UNUSED)
+{
+  page_discard (hash_entry (e, struct page, hash_elem));
+}
+
+/* Unmaps P, which has been taken out of the current process's
+   page table, writes it back if it is a dirty mapped page, and
+   frees it along with its frame or swap slot. */
+static void
+page_discard (struct page *p)
+{
+  uint32_t *pd = thread_current ()->pagedir;
+  struct frame *f;
+  bool swapped;
+
+  if (p->share != NULL)
+    {
+      share_detach (p);
+      free (p);
+      return;
+    }
+
+  lock_acquire (&frame_lock);
+  page_wait (p);
+  f = p->frame;
+  swapped = f == NULL && p->swap_slot != SWAP_ERROR;
+  if (f != NULL)
+    {
+      pagedir_clear_page (pd, p->upage);
+      if (p->type == PAGE_MMAP && pagedir_is_dirty (pd, p->upage))
+        {
+          /* Keep the evictor off the frame while we write it. */
+          f->pin_cnt++;
+          lock_release (&frame_lock);
+          file_write_at (p->file, f->kpage, p->read_bytes, p->ofs);
+          lock_acquire (&frame_lock);
+        }
+      frame_free (f);
+    }
+  lock_release (&frame_lock);
+
+  if (swapped)
+    swap_free (p->swap_slot);
+  free (p);
+}
@@ -0,0 +1,69 @@
+#ifndef VM_PAGE_H
+#define VM_PAGE_H
+
+#include <hash.h>
+#include <list.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "filesys/off_t.h"
+
+/* Largest size a process's stack may grow to. */
+#define STACK_MAX (8 * 1024 * 1024)
+
+struct file;
+struct share;
+struct thread;
+
+/* Where the contents of a page come from when it is brought in. */
+enum page_type
+  {
+    PAGE_FILE,                  /* Read from a file, rest zeroed. */
+    PAGE_ZERO,                  /* All zeros. */
+    PAGE_SWAP,                  /* Swap slot, once it has been written. */
+    PAGE_MMAP                   /* Mapped file, written back if dirty. */
+  };
+
+/*
+ * An entry in a process's supplemental page table, which records
+ * every page of the process's address space, whether or not it
+ * is resident.  The hardware page table only knows about the
+ * resident ones.
+ */
+struct page
+  {
+    void *upage;                        /* User virtual page. */
+    enum page_type type;
+    bool writable;
+    struct file *file;                  /* PAGE_FILE, PAGE_MMAP: file, */
+    off_t ofs;                          /* ...starting at this offset, */
+    size_t read_bytes;                  /* ...this many bytes. */
+    size_t swap_slot;                   /* PAGE_SWAP: slot, or SWAP_ERROR. */
+    struct thread *owner;               /* Process whose page this is. */
+    struct hash_elem hash_elem;         /* Element in thread's pages. */
+
+    /* Protected by frame_lock. */
+    struct frame *frame;                /* Frame holding page, if resident. */
+    bool evicting;                      /* Being written out by evictor? */
+    struct share *share;                /* Shared contents, if any. */
+    struct list_elem share_elem;        /* Element in share's pages. */
+  };
+
+bool page_table_create (void);
+bool page_table_copy (struct thread *parent, struct file *exec_file);
+void page_table_destroy (void);
+
+bool page_add_file (void *upage, struct file *, off_t ofs,
+                    size_t read_bytes, bool writable);
+bool page_add_zero (void *upage, bool writable);
+bool page_add_mmap (void *upage, struct file *, off_t ofs,
+                    size_t read_bytes);
+bool page_add_stack (const void *addr, const void *esp);
+void page_remove (void *upage);
+struct page *page_lookup (const void *upage);
+bool page_load (const void *addr);
+bool page_copy_on_write (const void *addr);
+bool page_pin_range (const void *uaddr, size_t size);
+void page_unpin_range (const void *uaddr, size_t size);
+void page_evict (struct page *, struct thread *owner);
+
+#endif /* vm/page.h */
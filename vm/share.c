@@ -0,0 +1,442 @@
+#include "vm/share.h"
+#include <debug.h>
+#include <stdio.h>
+#include <string.h>
+#include "filesys/file.h"
+#include "filesys/inode.h"
+#include "threads/malloc.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#include "userprog/pagedir.h"
+#include "vm/frame.h"
+#include "vm/page.h"
+#include "vm/swap.h"
+
+/*
+ * Sharing of read-only executable pages.  Every process that runs
+ * the same executable maps the same pages of its text from the
+ * same file offsets, and none of them can change those pages, so
+ * one frame can serve all of them.  The share table, keyed by the
+ * file's inode and the offset, holds one entry for each such page
+ * that some live process has in its page table.  The entry counts
+ * the processes' pages that refer to it and goes away with the
+ * last of them.
+ *
+ * The first process to touch the page reads it into a frame that
+ * then belongs to the entry, and every other process just maps
+ * that frame when it faults on the page.  When the clock picks the
+ * frame it is unmapped from every process at once; the next fault
+ * reads it in again, since it is never dirty.
+ *
+ * fork() shares the writable pages of the parent with the child
+ * the same way, through anonymous entries that are not in the
+ * table.  Both processes map such a page read-only, and the first
+ * one to write it gets a copy of its own, or takes over the frame
+ * if nobody else refers to the page any more.  An anonymous page
+ * goes to swap when evicted, since its contents exist nowhere else.
+ *
+ * Executables are open with writes denied for as long as any
+ * process runs them, so the contents cannot change under us.
+ * Everything here is protected by frame_lock.  While an entry is
+ * busy, its contents are being moved between its frame and the
+ * file system or swap, with frame_lock released.
+ */
+
+static struct hash shares;
+static unsigned long long share_hits, share_loads, share_copies;
+
+static void share_remove (struct page *);
+static void share_wait (struct share *);
+static bool share_map (struct page *, struct frame *, bool pin);
+static unsigned share_hash (const struct hash_elem *, void *);
+static bool share_less (const struct hash_elem *, const struct hash_elem *,
+                        void *);
+
+/* Initializes the share table. */
+void
+share_init (void)
+{
+  if (!hash_init (&shares, share_hash, share_less, NULL))
+    PANIC ("cannot create share table");
+}
+
+/* Prints share table statistics. */
+void
+share_print_stats (void)
+{
+  printf ("Shared pages: %zu in table, %llu loads, %llu hits, "
+          "%llu copied on write\n",
+          hash_size (&shares), share_loads, share_hits, share_copies);
+}
+
+/* Makes P, a read-only page of an executable that was just added
+   to the current process's page table, refer to the share table
+   entry for its contents, creating the entry if there is none.
+   If memory is short, P just stays private. */
+void
+share_attach (struct page *p)
+{
+  struct share key, *s;
+  struct hash_elem *e;
+
+  ASSERT (p->type == PAGE_FILE && !p->writable);
+
+  key.anonymous = false;
+  key.inumber = inode_get_inumber (file_get_inode (p->file));
+  key.ofs = p->ofs;
+  key.read_bytes = p->read_bytes;
+
+  lock_acquire (&frame_lock);
+  e = hash_find (&shares, &key.hash_elem);
+  if (e != NULL)
+    s = hash_entry (e, struct share, hash_elem);
+  else
+    {
+      s = malloc (sizeof *s);
+      if (s != NULL)
+        {
+          *s = key;
+          s->swap_slot = SWAP_ERROR;
+          s->frame = NULL;
+          s->busy = false;
+          list_init (&s->pages);
+          s->ref_cnt = 0;
+          hash_insert (&shares, &s->hash_elem);
+        }
+    }
+  if (s != NULL)
+    share_add (s, p);
+  lock_release (&frame_lock);
+}
+
+/* Moves the contents of P, a private writable page that is
+   resident or in swap, into a new anonymous entry and maps it
+   read-only in P's process, so that P can be shared with a child
+   by share_add().  Returns true if successful, false on out of
+   memory.  The caller must hold frame_lock. */
+bool
+share_cow (struct page *p)
+{
+  struct share *s;
+
+  ASSERT (lock_held_by_current_thread (&frame_lock));
+  ASSERT (p->share == NULL && p->writable && !p->evicting);
+
+  s = malloc (sizeof *s);
+  if (s == NULL)
+    return false;
+  s->anonymous = true;
+  s->swap_slot = p->swap_slot;
+  s->frame = p->frame;
+  s->busy = false;
+  list_init (&s->pages);
+  s->ref_cnt = 0;
+  if (s->frame != NULL)
+    {
+      s->frame->page = NULL;
+      s->frame->share = s;
+      pagedir_set_writable (p->owner->pagedir, p->upage, false);
+    }
+  p->swap_slot = SWAP_ERROR;
+  share_add (s, p);
+  return true;
+}
+
+/* Makes P refer to S, mapping S's frame at P right away if it is
+   resident.  The caller must hold frame_lock. */
+void
+share_add (struct share *s, struct page *p)
+{
+  ASSERT (lock_held_by_current_thread (&frame_lock));
+
+  list_push_back (&s->pages, &p->share_elem);
+  s->ref_cnt++;
+  p->share = s;
+  if (s->frame != NULL && p->frame == NULL && !s->busy)
+    share_map (p, s->frame, false);
+}
+
+/* Unmaps P, which is being discarded by the current process, and
+   drops its reference to its entry, freeing the entry with its
+   frame or swap slot if that was the last one. */
+void
+share_detach (struct page *p)
+{
+  lock_acquire (&frame_lock);
+  share_wait (p->share);
+  if (p->frame != NULL)
+    {
+      pagedir_clear_page (p->owner->pagedir, p->upage);
+      p->frame = NULL;
+    }
+  share_remove (p);
+  lock_release (&frame_lock);
+}
+
+/* Maps P, which is not resident, to the frame of its entry,
+   reading the page into a new frame first if no process has it
+   resident.  The frame stays pinned if PIN is true.  Returns true
+   if successful, false if no frame can be had or the page cannot
+   be read. */
+bool
+share_in (struct page *p, bool pin)
+{
+  struct share *s = p->share;
+  struct frame *f;
+  bool success;
+
+  lock_acquire (&frame_lock);
+  share_wait (s);
+  if (s->frame != NULL)
+    {
+      share_hits++;
+      success = share_map (p, s->frame, pin);
+      lock_release (&frame_lock);
+      return success;
+    }
+  s->busy = true;
+  lock_release (&frame_lock);
+
+  f = frame_alloc (NULL);
+  if (f != NULL && s->anonymous)
+    swap_in (s->swap_slot, f->kpage);
+  else if (f != NULL
+           && file_read_at (p->file, f->kpage, s->read_bytes, s->ofs)
+              == (off_t) s->read_bytes)
+    memset ((uint8_t *) f->kpage + s->read_bytes, 0,
+            PGSIZE - s->read_bytes);
+  else if (f != NULL)
+    {
+      lock_acquire (&frame_lock);
+      frame_free (f);
+      lock_release (&frame_lock);
+      f = NULL;
+    }
+
+  lock_acquire (&frame_lock);
+  s->busy = false;
+  cond_broadcast (&frame_evicted, &frame_lock);
+  success = false;
+  if (f != NULL)
+    {
+      share_loads++;
+      if (s->anonymous)
+        s->swap_slot = SWAP_ERROR;
+      s->frame = f;
+      f->share = s;
+      success = share_map (p, f, pin);
+      f->pin_cnt--;
+    }
+  lock_release (&frame_lock);
+  return success;
+}
+
+/* Gives P, an anonymous page of the current process that the
+   process just tried to write, contents of its own and maps them
+   writable.  Returns true if successful, false if no frame can be
+   had. */
+bool
+share_write (struct page *p)
+{
+  struct share *s = p->share;
+  uint32_t *pd = p->owner->pagedir;
+  struct frame *f;
+
+  ASSERT (s->anonymous && p->writable);
+
+  lock_acquire (&frame_lock);
+  share_wait (s);
+  if (s->ref_cnt == 1 && p->frame != NULL)
+    {
+      /* Nobody else refers to the page any more, so just take
+         over its frame. */
+      f = s->frame;
+      s->frame = NULL;
+      share_remove (p);
+      f->share = NULL;
+      f->page = p;
+      f->owner = p->owner;
+      p->type = PAGE_SWAP;
+      pagedir_set_writable (pd, p->upage, true);
+      lock_release (&frame_lock);
+      return true;
+    }
+  lock_release (&frame_lock);
+
+  f = frame_alloc (p);
+  if (f == NULL)
+    return false;
+
+  lock_acquire (&frame_lock);
+  share_wait (s);
+  if (s->frame != NULL)
+    memcpy (f->kpage, s->frame->kpage, PGSIZE);
+  else
+    {
+      s->busy = true;
+      lock_release (&frame_lock);
+      swap_read (s->swap_slot, f->kpage);
+      lock_acquire (&frame_lock);
+      s->busy = false;
+      cond_broadcast (&frame_evicted, &frame_lock);
+    }
+
+  if (p->frame != NULL)
+    {
+      pagedir_clear_page (pd, p->upage);
+      p->frame = NULL;
+    }
+  if (!pagedir_set_page (pd, p->upage, f->kpage, true))
+    {
+      frame_free (f);
+      lock_release (&frame_lock);
+      return false;
+    }
+  share_copies++;
+  share_remove (p);
+  p->type = PAGE_SWAP;
+  p->frame = f;
+  f->pin_cnt--;
+  lock_release (&frame_lock);
+  return true;
+}
+
+/* Returns true if any process that has S resident accessed it
+   since the last call, and clears their accessed bits. */
+bool
+share_accessed (struct share *s)
+{
+  struct list_elem *e;
+  bool accessed = false;
+
+  ASSERT (lock_held_by_current_thread (&frame_lock));
+
+  for (e = list_begin (&s->pages); e != list_end (&s->pages);
+       e = list_next (e))
+    {
+      struct page *p = list_entry (e, struct page, share_elem);
+      uint32_t *pd = p->owner->pagedir;
+
+      if (p->frame != NULL && pagedir_is_accessed (pd, p->upage))
+        {
+          pagedir_set_accessed (pd, p->upage, false);
+          accessed = true;
+        }
+    }
+  return accessed;
+}
+
+/* Unmaps S from every process that has it resident and takes its
+   frame away, which the caller has pinned, writing it to swap
+   first if S is anonymous.  The caller must hold frame_lock, which
+   is released during the write. */
+void
+share_evict (struct share *s)
+{
+  struct list_elem *e;
+
+  ASSERT (lock_held_by_current_thread (&frame_lock));
+  ASSERT (s->frame != NULL && s->frame->pin_cnt > 0 && !s->busy);
+
+  for (e = list_begin (&s->pages); e != list_end (&s->pages);
+       e = list_next (e))
+    {
+      struct page *p = list_entry (e, struct page, share_elem);
+
+      if (p->frame != NULL)
+        {
+          pagedir_clear_page (p->owner->pagedir, p->upage);
+          p->frame = NULL;
+        }
+    }
+
+  if (s->anonymous)
+    {
+      size_t slot;
+
+      s->busy = true;
+      lock_release (&frame_lock);
+      slot = swap_out (s->frame->kpage);
+      lock_acquire (&frame_lock);
+      if (slot == SWAP_ERROR)
+        PANIC ("out of swap space");
+      s->swap_slot = slot;
+      s->busy = false;
+      cond_broadcast (&frame_evicted, &frame_lock);
+    }
+  s->frame = NULL;
+}
+
+/* Drops P's reference to its entry, freeing the entry with its
+   frame or swap slot if that was the last one.  P must already be
+   unmapped.  The caller must hold frame_lock. */
+static void
+share_remove (struct page *p)
+{
+  struct share *s = p->share;
+
+  ASSERT (lock_held_by_current_thread (&frame_lock));
+  ASSERT (!s->busy);
+
+  list_remove (&p->share_elem);
+  p->share = NULL;
+  if (--s->ref_cnt == 0)
+    {
+      if (s->frame != NULL)
+        frame_free (s->frame);
+      if (s->swap_slot != SWAP_ERROR)
+        swap_free (s->swap_slot);
+      if (!s->anonymous)
+        hash_delete (&shares, &s->hash_elem);
+      free (s);
+    }
+}
+
+/* Waits until S is not busy.  The caller must hold frame_lock. */
+static void
+share_wait (struct share *s)
+{
+  while (s->busy)
+    cond_wait (&frame_evicted, &frame_lock);
+}
+
+/* Maps F, the frame of P's entry, read-only at P in P's process,
+   and pins it once more if PIN is true.  Returns true if
+   successful, false if the page table cannot be extended.  The
+   caller must hold frame_lock. */
+static bool
+share_map (struct page *p, struct frame *f, bool pin)
+{
+  uint32_t *pd = p->owner->pagedir;
+
+  if (!pagedir_set_page (pd, p->upage, f->kpage, false))
+    return false;
+  pagedir_set_accessed (pd, p->upage, true);
+  p->frame = f;
+  if (pin)
+    f->pin_cnt++;
+  return true;
+}
+
+/* Hashes a share table entry by inode and offset. */
+static unsigned
+share_hash (const struct hash_elem *e, void *aux UNUSED)
+{
+  const struct share *s = hash_entry (e, struct share, hash_elem);
+  return hash_int (s->inumber) ^ hash_int (s->ofs);
+}
+
+/* Orders share table entries by inode, offset, and length. */
+static bool
+share_less (const struct hash_elem *a_, const struct hash_elem *b_,
+            void *aux UNUSED)
+{
+  const struct share *a = hash_entry (a_, struct share, hash_elem);
+  const struct share *b = hash_entry (b_, struct share, hash_elem);
+
+  if (a->inumber != b->inumber)
+    return a->inumber < b->inumber;
+  if (a->ofs != b->ofs)
+    return a->ofs < b->ofs;
+  return a->read_bytes < b->read_bytes;
+}
@@ -0,0 +1,44 @@
+#ifndef VM_SHARE_H
+#define VM_SHARE_H
+
+#include <hash.h>
+#include <list.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "devices/block.h"
+#include "filesys/off_t.h"
+
+struct frame;
+struct page;
+
+/* Contents of a page mapped read-only from one frame into several
+   processes: either a read-only page of an executable, or a
+   copy-on-write page of processes related by fork().  Protected
+   by frame_lock. */
+struct share
+  {
+    bool anonymous;                     /* Copy-on-write, not in table? */
+    block_sector_t inumber;             /* Inode of the file... */
+    off_t ofs;                          /* ...offset of the page in it, */
+    size_t read_bytes;                  /* ...and bytes read from it. */
+    size_t swap_slot;                   /* Anonymous: slot, or SWAP_ERROR. */
+    struct frame *frame;                /* Frame holding page, if resident. */
+    bool busy;                          /* Frame being read or written? */
+    struct list pages;                  /* Pages of processes sharing it. */
+    int ref_cnt;                        /* Number of pages in PAGES. */
+    struct hash_elem hash_elem;         /* Element in share table. */
+  };
+
+void share_init (void);
+void share_print_stats (void);
+
+void share_attach (struct page *);
+bool share_cow (struct page *);
+void share_add (struct share *, struct page *);
+void share_detach (struct page *);
+bool share_in (struct page *, bool pin);
+bool share_write (struct page *);
+bool share_accessed (struct share *);
+void share_evict (struct share *);
+
+#endif /* vm/share.h */
@@ -0,0 +1,117 @@
+#include "vm/swap.h"
+#include <bitmap.h>
+#include <debug.h>
+#include <stdio.h>
+#include "devices/block.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+
+/*
+ * The swap device is divided into page-sized slots, and a bitmap
+ * records which of them hold a page.  Every page is moved with one
+ * multi-sector request.
+ */
+
+/* Number of sectors in a slot. */
+#define SLOT_SECTORS (PGSIZE / BLOCK_SECTOR_SIZE)
+
+static struct block *swap_device;       /* Null if there is none. */
+static struct lock swap_lock;           /* Protects everything below. */
+static struct bitmap *used_slots;       /* Slots holding a page. */
+static unsigned long long pages_out, pages_in;
+
+static void slot_sectors (const void *kpage, void *sectors[SLOT_SECTORS]);
+
+/* Initializes the swap slot allocator on the swap device, if
+   there is one.  Without a swap device, pages that would need to
+   be swapped out cannot be evicted. */
+void
+swap_init (void)
+{
+  lock_init (&swap_lock);
+  swap_device = block_get_role (BLOCK_SWAP);
+  if (swap_device == NULL)
+    return;
+  used_slots = bitmap_create (block_size (swap_device) / SLOT_SECTORS);
+  if (used_slots == NULL)
+    PANIC ("bitmap creation failed--swap device is too large");
+}
+
+/* Prints swap statistics. */
+void
+swap_print_stats (void)
+{
+  if (swap_device != NULL)
+    printf ("Swap: %zu of %zu slots in use, %llu pages out, %llu in\n",
+            bitmap_count (used_slots, 0, bitmap_size (used_slots), true),
+            bitmap_size (used_slots), pages_out, pages_in);
+}
+
+/* Writes the page at KPAGE to a free swap slot and returns the
+   slot, or SWAP_ERROR if there is no free slot. */
+size_t
+swap_out (const void *kpage)
+{
+  void *sectors[SLOT_SECTORS];
+  size_t slot;
+
+  if (swap_device == NULL)
+    return SWAP_ERROR;
+
+  lock_acquire (&swap_lock);
+  slot = bitmap_scan_and_flip (used_slots, 0, 1, false);
+  if (slot != BITMAP_ERROR)
+    pages_out++;
+  lock_release (&swap_lock);
+  if (slot == BITMAP_ERROR)
+    return SWAP_ERROR;
+
+  slot_sectors (kpage, sectors);
+  block_write_multiple (swap_device, slot * SLOT_SECTORS, SLOT_SECTORS,
+                        (const void *const *) sectors);
+  return slot;
+}
+
+/* Reads the page in SLOT into KPAGE and frees SLOT. */
+void
+swap_in (size_t slot, void *kpage)
+{
+  swap_read (slot, kpage);
+  swap_free (slot);
+}
+
+/* Reads the page in SLOT into KPAGE, keeping SLOT in use. */
+void
+swap_read (size_t slot, void *kpage)
+{
+  void *sectors[SLOT_SECTORS];
+
+  slot_sectors (kpage, sectors);
+  block_read_multiple (swap_device, slot * SLOT_SECTORS, SLOT_SECTORS,
+                       sectors);
+
+  lock_acquire (&swap_lock);
+  pages_in++;
+  lock_release (&swap_lock);
+}
+
+/* Frees SLOT without reading it. */
+void
+swap_free (size_t slot)
+{
+  lock_acquire (&swap_lock);
+  ASSERT (bitmap_test (used_slots, slot));
+  bitmap_reset (used_slots, slot);
+  lock_release (&swap_lock);
+}
+
+/* Stores pointers to the sector-sized pieces of KPAGE in
+   SECTORS. */
+static void
+slot_sectors (const void *kpage, void *sectors[SLOT_SECTORS])
+{
+  size_t i;
+
+  for (i = 0; i < SLOT_SECTORS; i++)
+    sectors[i] = (uint8_t *) kpage + i * BLOCK_SECTOR_SIZE;
+}